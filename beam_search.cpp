@@ -0,0 +1,181 @@
+#include "beam_search.h"
+#include "engine.h"
+
+#include <algorithm>
+#include <functional>
+#include <cassert>
+
+using std::optional;
+using std::min;
+using std::size_t;
+using std::uint32_t;
+using std::chrono::steady_clock;
+
+// Workers look at the clock before every this many expansions, so a ply overruns the deadline by at most that many.
+static const long c_expansions_per_deadline_check = 8;
+
+Beam_search::Beam_search(Engine& _engine, int _beam_width)
+    : engine{_engine}, beam_width{_beam_width} {
+
+    assert(beam_width > 0);
+}
+
+optional<Beam_search::Result> Beam_search::search(State&& root, optional<steady_clock::time_point> deadline){
+
+    assert(!root.get_is_leaf());
+    root.use_board_settings(engine.get_board_settings());
+
+    outputs.resize(engine.get_num_workers());
+    for(auto& output : outputs){
+        output.best_leaf.reset();
+        output.num_considered = 0;
+        output.counters = {};
+        output.cut_short = false;
+    }
+
+    // The root is a beam of one.
+    beam.clear();
+    beam.push_back(Node{root.get_board().get_utility_key(), root.get_transposition_key(), 0, 0, root.compact(root)});
+
+    // The root's ply always finishes, so there is a placement to pick.
+    optional<steady_clock::time_point> ply_deadline;
+    // The policy is chosen once, not per child.
+    const Policy_id policy_id = engine.get_board_settings().policy;
+    const auto expand_task = dispatch_on_policy(policy_id, [this, &root, &ply_deadline](auto policy){
+        return std::function<void(int)>{[this, &root, &ply_deadline](int worker_x){
+            expand<decltype(policy)>(worker_x, root, ply_deadline);
+        }};
+    });
+
+    long peak_beam_size = 0;
+    while(!beam.empty()){
+        peak_beam_size = std::max(peak_beam_size, static_cast<long>(beam.size()));
+        engine.run_on_every_worker(expand_task);
+        // Children of part of a beam are not the best of the ply, so a ply cut short keeps the beam it had.
+        if(std::any_of(outputs.begin(), outputs.end(), [](const Worker_output& output){ return output.cut_short; })){
+            break;
+        }
+        select_next_beam();
+        if(deadline && steady_clock::now() >= *deadline){
+            break;
+        }
+        ply_deadline = deadline;
+    }
+
+    optional<Node> best_leaf;
+    long states_considered = 0;
+    Search_counters counters;
+    for(const auto& output : outputs){
+        if(output.best_leaf && (!best_leaf || is_better(*output.best_leaf, *best_leaf))){
+            best_leaf = output.best_leaf;
+        }
+        states_considered += output.num_considered;
+        counters += output.counters;
+    }
+    counters.peak_states_waiting = peak_beam_size;
+
+    // A deadline can stop us before any leaf is found. Then the beam is still sorted best first.
+    // Otherwise the beam only runs out before a leaf is found if every child of its last ply topped out.
+    if(!best_leaf && beam.empty()){
+        return {};
+    }
+    const State best_state{best_leaf ? best_leaf->state : beam.front().state, root};
+    return Result{
+        best_state.get_placement_taken_from_root(),
+        best_state.get_second_placement_taken_from_root(),
+        best_state.get_board().get_num_blocks_placed() - root.get_board().get_num_blocks_placed(),
+        states_considered,
+        counters
+    };
+}
+
+template <class Policy>
+void Beam_search::expand(int worker_x, const State& root, optional<steady_clock::time_point> deadline){
+
+    Worker_output& output = outputs[worker_x];
+    output.children.clear();
+
+    State::Placement_list_t placements;
+    State::Undo_record undo_record;
+
+    // Deal the beam out like cards, so every worker gets some of the best states.
+    long num_expanded = 0;
+    for(size_t beam_x = worker_x; beam_x < beam.size(); beam_x += outputs.size()){
+
+        if(deadline && num_expanded++ % c_expansions_per_deadline_check == 0 && steady_clock::now() >= *deadline){
+            output.cut_short = true;
+            return;
+        }
+
+        State state{beam[beam_x].state, root};
+        const int num_placements = state.generate_ordered_placements<Policy>(placements);
+        ++output.counters.num_expanded;
+        // Every placement but the hold is a drop. Those not generated were ruled out by scan_rotation().
+        output.counters.num_rejected += state.get_presented_block().get_num_drop_placements() - (num_placements - 1);
+
+        for(int placement_x = 0; placement_x < num_placements; ++placement_x){
+            const Placement placement = placements[placement_x].placement;
+            if(!state.make_child<Policy>(placement, undo_record)){
+                // A hold that cannot be made is not a placement, so is not counted.
+                output.counters.num_rejected += !placement.get_is_hold();
+                continue;
+            }
+            ++output.num_considered;
+            ++output.counters.num_children;
+            output.counters.num_hold_branches += placement.get_is_hold();
+
+            Node child{
+                state.get_board().get_utility_key<Policy>(),
+                0,
+                static_cast<uint32_t>(beam_x),
+                static_cast<uint32_t>(placement_x),
+                state.compact(root)
+            };
+            if(state.get_is_leaf()){
+                ++output.counters.num_leaves_scored;
+                if(!output.best_leaf || is_better(child, *output.best_leaf)){
+                    output.best_leaf = child;
+                }
+            }
+            else{
+                child.transposition_key = state.get_transposition_key();
+                output.children.push_back(child);
+            }
+
+            state.unmake_child(undo_record);
+        }
+    }
+}
+
+void Beam_search::select_next_beam(){
+
+    candidates.clear();
+    for(const auto& output : outputs){
+        candidates.insert(candidates.end(), output.children.begin(), output.children.end());
+    }
+
+    // Keep one of each position, the one ties would pick.
+    std::sort(candidates.begin(), candidates.end(), [](const Node& n1, const Node& n2){
+        if(n1.transposition_key != n2.transposition_key){
+            return n1.transposition_key < n2.transposition_key;
+        }
+        return is_better(n1, n2);
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const Node& n1, const Node& n2){
+        return n1.transposition_key == n2.transposition_key;
+    }), candidates.end());
+
+    const size_t beam_size = min(static_cast<size_t>(beam_width), candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + beam_size, candidates.end(), is_better);
+    beam.assign(candidates.begin(), candidates.begin() + beam_size);
+}
+
+bool Beam_search::is_better(const Node& n1, const Node& n2){
+    if(n1.key > n2.key || n2.key > n1.key){
+        return n1.key > n2.key;
+    }
+    if(n1.parent_x != n2.parent_x){
+        return n1.parent_x < n2.parent_x;
+    }
+    return n1.child_x < n2.child_x;
+}
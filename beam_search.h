@@ -0,0 +1,85 @@
+#ifndef BEAM_SEARCH_H
+#define BEAM_SEARCH_H
+
+#include "state.h"
+#include "board.h"
+#include "engine.h"
+
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <cstdint>
+
+// Level synchronous beam search, run on an Engine's workers.
+// Every ply, all states in the beam are expanded at once across the workers, children are scored by
+// their board's utility key, and only the beam_width best distinct children make up the next beam.
+// Work per move is bounded by about beam_width * plies * children per state, however deep it looks.
+// Unlike the depth first search, the best leaf is not guaranteed to be found.
+class Beam_search {
+
+public:
+
+    struct Result {
+        Placement placement;
+        // What it expects to do next turn, if things go as it predicts.
+        std::optional<Placement> predicted_next_placement;
+        // Placements from the root to the state the placement was chosen for.
+        int depth_reached;
+        long states_considered;
+        // Nothing is stolen, so no offloads. The peak is the largest beam.
+        Search_counters counters;
+    };
+
+    Beam_search(Engine& _engine, int _beam_width);
+
+    // Requires: Workers are free. Root is not a leaf.
+    // Root uses the engine's board settings from now on.
+    // Once the deadline passes, stops within a few expansions, and picks from the leaves it has seen and
+    // the last ply it finished.
+    // Empty iff every line it kept topped out before reaching a leaf.
+    std::optional<Result> search(State&& root, std::optional<std::chrono::steady_clock::time_point> deadline = {});
+
+    Beam_search(const Beam_search& other) = delete;
+    Beam_search& operator=(const Beam_search& other) = delete;
+
+private:
+
+    struct Node {
+        Utility_key key;
+        std::uint64_t transposition_key;
+        // Rank of the parent in its beam, then order among its siblings. Breaks ties in key the same way
+        // however many workers there are.
+        std::uint32_t parent_x;
+        std::uint32_t child_x;
+        Compact_state state;
+    };
+
+    // Per worker. Only touched by that worker during a ply.
+    struct Worker_output {
+        std::vector<Node> children;
+        std::optional<Node> best_leaf;
+        long num_considered = 0;
+        Search_counters counters;
+        // True iff the deadline passed before every beam state assigned to this worker was expanded.
+        bool cut_short = false;
+    };
+
+    // Expand every beam state assigned to this worker, or as many as it can before the deadline.
+    template <class Policy>
+    void expand(int worker_x, const State& root, std::optional<std::chrono::steady_clock::time_point> deadline);
+    // Replace beam with the best beam_width distinct children of this ply.
+    void select_next_beam();
+
+    // Returns true iff n1 should be preferred over n2.
+    static bool is_better(const Node& n1, const Node& n2);
+
+    Engine& engine;
+    const int beam_width;
+
+    std::vector<Node> beam;
+    std::vector<Worker_output> outputs;
+    // Every child of this ply, gathered from the outputs. Kept around so its capacity is reused.
+    std::vector<Node> candidates;
+};
+
+#endif
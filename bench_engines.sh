@@ -0,0 +1,39 @@
+#!/bin/bash
+# Compares the search engines on the same seeded games, watching Jeff play.
+# Prints tetris percent and milliseconds per move, averaged over the seeds.
+# Usage: ./bench_engines.sh [game length] [num threads] [seed ...]
+# Plays with ./main, or with $MAIN if set. make bench_engines sets it to a release build.
+
+game_length=${1:-100}
+num_threads=${2:-1}
+shift $(( $# < 2 ? $# : 2 ))
+seeds=${@:-1 2 3 4 5}
+main=${MAIN:-./main}
+
+# <label>:<lookahead> <queue size> [key=value ...]
+# Exhaustive search takes seconds per move at lookahead 6, so compare at 5.
+configs=(
+    "dfs:5 6 engine=dfs"
+    "beam 64:5 6 engine=beam beam_width=64"
+    "beam 256:5 6 engine=beam beam_width=256"
+    "beam 256, deep:10 12 engine=beam beam_width=256"
+)
+
+printf "%-16s %10s %10s %14s\n" "engine" "lookahead" "tetris %" "ms per move"
+for config in "${configs[@]}"; do
+    label=${config%%:*}
+    read -r lookahead queue_size settings <<< "${config#*:}"
+    total_tetris_percent=0
+    total_ms_per_move=0
+    for seed in $seeds; do
+        output=$("$main" w "$seed" "$lookahead" "$queue_size" "$game_length" "$num_threads" n $settings)
+        tetris_percent=$(grep "^Tetris percent: " <<< "$output" | awk '{print $3}')
+        ms_per_move=$(grep "^Ms per move: " <<< "$output" | awk '{print $4}')
+        total_tetris_percent=$(awk "BEGIN {print $total_tetris_percent + $tetris_percent}")
+        total_ms_per_move=$(awk "BEGIN {print $total_ms_per_move + $ms_per_move}")
+    done
+    num_seeds=$(wc -w <<< "$seeds")
+    printf "%-16s %10s %10.2f %14.3f\n" "$label" "$lookahead" \
+        "$(awk "BEGIN {print $total_tetris_percent / $num_seeds}")" \
+        "$(awk "BEGIN {print $total_ms_per_move / $num_seeds}")"
+done
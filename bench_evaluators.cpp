@@ -0,0 +1,93 @@
+// Times board scoring with the hand-written utility and with the learned evaluator, on the same boards.
+// Usage: ./bench_evaluators [weights file] [num boards]
+
+#include "board.h"
+#include "block.h"
+#include "learned_evaluator.h"
+#include "rollout.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// Boards from greedy games, restarted whenever one tops out, so the corpus has all kinds of stacks.
+static vector<Board> make_corpus(size_t num_boards){
+
+    std::mt19937 generator{1};
+    std::uniform_int_distribution<int> block_dist{0, Block::c_num_blocks - 1};
+
+    vector<Board> boards;
+    boards.reserve(num_boards);
+    Board board;
+    while(boards.size() < num_boards){
+        board.load_ancestral_data_with_current_data();
+        if(!place_greedily(board, *Block::all_blocks[block_dist(generator)])){
+            board = Board{};
+            continue;
+        }
+        boards.push_back(board);
+    }
+    return boards;
+}
+
+// Nanoseconds per get_utility_key(), scoring every board num_passes times with settings.
+static double time_utility_keys(vector<Board> boards, const Board_settings& settings, int num_passes){
+
+    for(Board& board : boards){
+        board.use_settings(settings);
+    }
+    // Keeps the keys from being optimized away.
+    std::uint64_t checksum = 0;
+    const auto start = steady_clock::now();
+    for(int pass_x = 0; pass_x < num_passes; ++pass_x){
+        for(const Board& board : boards){
+            const Utility_key key = board.get_utility_key();
+            checksum += key.primary ^ key.secondary;
+        }
+    }
+    const duration<double, std::nano> elapsed = steady_clock::now() - start;
+    if(checksum == 42){
+        cout << "";
+    }
+    return elapsed.count() / (static_cast<double>(boards.size()) * num_passes);
+}
+
+int main(int argc, char* argv[]){
+
+    const string weights_path = argc > 1 ? argv[1] : "evaluator_weights.txt";
+    const size_t num_boards = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    const int num_passes = 20;
+
+    const vector<Board> boards = make_corpus(num_boards);
+    const Learned_evaluator vectorized{weights_path};
+    const Learned_evaluator scalar{weights_path, false};
+
+    cout << std::fixed << std::setprecision(1);
+    cout << "Boards: " << boards.size() << ", passes: " << num_passes << endl;
+    cout << "Hand-written utility: " << time_utility_keys(boards, Board_settings{}, num_passes) << " ns per board" << endl;
+
+    const Board_settings scalar_settings{Policy_id::standard, Pruning_rules{}, &scalar};
+    cout << "Learned, scalar: " << time_utility_keys(boards, scalar_settings, num_passes) << " ns per board" << endl;
+
+    if(vectorized.is_vectorized()){
+        const Board_settings vectorized_settings{Policy_id::standard, Pruning_rules{}, &vectorized};
+        cout << "Learned, AVX2: " << time_utility_keys(boards, vectorized_settings, num_passes) << " ns per board" << endl;
+    }
+    else{
+        cout << "Learned, AVX2: not supported on this CPU" << endl;
+    }
+
+    return 0;
+}
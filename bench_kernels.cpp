@@ -0,0 +1,472 @@
+// Times the Board, State and Action kernels the search spends its time in, on mid-game boards.
+// Reports ns and allocations per op, and compares against a baseline saved by an earlier run.
+// Every kernel is timed over several interleaved rounds, and the median round is reported, with how much
+// rounds spread around it. Only a change bigger than that noise, and than a floor, is flagged.
+// Usage: ./bench_kernels [baseline file] [save]
+// With no baseline file yet, or with save, this run's times become the baseline.
+// Exits non zero iff some kernel is flagged.
+
+#include "board.h"
+#include "block.h"
+#include "state.h"
+#include "action.h"
+#include "rollout.h"
+#include "search_policy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::map;
+using std::optional;
+using std::function;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// Every heap allocation this program makes. Single threaded, so no need for an atomic.
+static long num_allocations = 0;
+
+void* operator new(size_t size){
+    ++num_allocations;
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// A mid-game board, and a promising placement of a block on it.
+struct Position {
+    Board board;
+    const Block* block;
+    Placement placement;
+};
+
+// Only boards this many placements into a greedy game are kept, so stacks have built up.
+static const int c_min_blocks_placed = 10;
+// Slower than its baseline by more than this, and by more than c_noise_multiple times its noise, is flagged.
+// Medians of the same build move by up to about 15% from run to run, more than the rounds of one run spread.
+static const double c_min_regression_percent = 20;
+static const double c_noise_multiple = 3;
+// Rounds of timing every kernel once, interleaved so drift in clock speed hits every kernel alike.
+static const int c_num_rounds = 7;
+static const int c_num_passes = 4;
+
+// Boards from greedy games, restarted whenever one tops out, each with a random promising placement.
+static vector<Position> make_corpus(size_t num_positions){
+
+    std::mt19937 generator{1};
+    std::uniform_int_distribution<int> block_dist{0, Block::c_num_blocks - 1};
+
+    vector<Position> positions;
+    positions.reserve(num_positions);
+    Board board;
+    while(positions.size() < num_positions){
+        board.load_ancestral_data_with_current_data();
+        if(!place_greedily(board, *Block::all_blocks[block_dist(generator)])){
+            board = Board{};
+            continue;
+        }
+        if(board.get_num_blocks_placed() < c_min_blocks_placed){
+            continue;
+        }
+        board.load_ancestral_data_with_current_data();
+        const Block& block = *Block::all_blocks[block_dist(generator)];
+        const int rot_x = std::uniform_int_distribution<int>{0, block.num_rotations - 1}(generator);
+        const std::uint16_t promising_cols = board.scan_rotation(block, rot_x).promising_cols;
+        if(!promising_cols){
+            continue;
+        }
+        // Any promising column. Not uniform, but it does not need to be.
+        int col_x = std::uniform_int_distribution<int>{0, Board::c_cols - 1}(generator);
+        while(!(promising_cols >> col_x & 1u)){
+            col_x = (col_x + 1) % Board::c_cols;
+        }
+        positions.push_back(Position{board, &block, Placement{rot_x, col_x, false}});
+    }
+    return positions;
+}
+
+struct Measurement {
+    double ns_per_op;
+    double allocations_per_op;
+};
+
+// Runs setup then body c_num_passes times, timing only body, which does num_ops ops.
+// The fastest pass is kept, since noise within a round only ever slows a pass down.
+static Measurement measure(long num_ops, const function<void()>& setup, const function<void()>& body){
+
+    double best_ns = 0;
+    long allocations = 0;
+    for(int pass_x = 0; pass_x < c_num_passes; ++pass_x){
+        setup();
+        const long allocations_before = num_allocations;
+        const auto start = steady_clock::now();
+        body();
+        const duration<double, std::nano> elapsed = steady_clock::now() - start;
+        allocations += num_allocations - allocations_before;
+        if(pass_x == 0 || elapsed.count() < best_ns){
+            best_ns = elapsed.count();
+        }
+    }
+    return Measurement{best_ns / num_ops, static_cast<double>(allocations) / (static_cast<double>(num_ops) * c_num_passes)};
+}
+
+// Keeps results from being optimized away.
+static std::uint64_t checksum = 0;
+
+// Reaches into Board for the kernels place_block() is built from.
+struct Kernel_bench {
+
+    // Insert num_rows full rows under the lowest column of each board, so clear_full_rows() has them to clear.
+    // Boards too tall to take them are left out.
+    static vector<Board> add_full_rows(const vector<Position>& positions, int num_rows, vector<int>& lowest_rows){
+
+        vector<Board> boards;
+        lowest_rows.clear();
+        for(const Position& position : positions){
+            Board board = position.board;
+            if(board.highest_height + num_rows > static_cast<int>(Board::c_rows)){
+                continue;
+            }
+            const int lowest_row = board.lowest_height / 2;
+            for(int row_x = board.highest_height - 1; row_x >= lowest_row; --row_x){
+                board.board[row_x + num_rows] = board.board[row_x];
+            }
+            for(int row_x = lowest_row; row_x < lowest_row + num_rows; ++row_x){
+                board.board[row_x] = Board::c_full_row;
+            }
+            for(auto& height : board.height_map){
+                height += num_rows;
+            }
+            board.highest_height += num_rows;
+            board.num_cells_filled += num_rows * Board::c_cols;
+            board.perfect_num_cells_filled += num_rows * Board::c_cols;
+            board.zobrist_hash = board.compute_zobrist_hash();
+            boards.push_back(board);
+            lowest_rows.push_back(lowest_row);
+        }
+        return boards;
+    }
+
+    static Measurement time_clear_full_rows(const vector<Position>& positions, int num_rows){
+
+        vector<int> lowest_rows;
+        const vector<Board> boards = add_full_rows(positions, num_rows, lowest_rows);
+        vector<Board> work;
+        return measure(static_cast<long>(boards.size()),
+            [&](){
+                work = boards;
+            },
+            [&](){
+                for(size_t board_x = 0; board_x < work.size(); ++board_x){
+                    // place_block() looks at every row the block covers, which is at least the rows it fills.
+                    const int highest_row = std::min(lowest_rows[board_x] + 3, static_cast<int>(Board::c_rows) - 1);
+                    checksum += work[board_x].clear_full_rows(lowest_rows[board_x], highest_row);
+                }
+            });
+    }
+
+    static Measurement time_update_secondary_cache(const vector<Position>& positions){
+
+        vector<Board> work;
+        return measure(static_cast<long>(positions.size()),
+            [&](){
+                work.clear();
+                for(const Position& position : positions){
+                    work.push_back(position.board);
+                }
+            },
+            [&](){
+                for(Board& board : work){
+                    board.update_secondary_cache();
+                    checksum += board.second_lowest_height;
+                }
+            });
+    }
+
+    static Measurement time_is_promising(const vector<Position>& positions){
+
+        return measure(static_cast<long>(positions.size()),
+            [](){},
+            [&](){
+                for(const Position& position : positions){
+                    checksum += position.board.is_promising<Standard_policy>();
+                }
+            });
+    }
+};
+
+static Measurement time_place_block(const vector<Position>& positions){
+
+    vector<Board> work;
+    return measure(static_cast<long>(positions.size()),
+        [&](){
+            work.clear();
+            for(const Position& position : positions){
+                work.push_back(position.board);
+            }
+        },
+        [&](){
+            for(size_t position_x = 0; position_x < positions.size(); ++position_x){
+                const Position& position = positions[position_x];
+                checksum += work[position_x].place_block<Standard_policy>(*position.block, position.placement);
+            }
+        });
+}
+
+static Measurement time_has_greater_utility_than(const vector<Position>& positions){
+
+    return measure(static_cast<long>(positions.size() - 1),
+        [](){},
+        [&](){
+            for(size_t position_x = 0; position_x + 1 < positions.size(); ++position_x){
+                checksum += positions[position_x].board.has_greater_utility_than<Standard_policy>(
+                    positions[position_x + 1].board);
+            }
+        });
+}
+
+// A root on each board, with the rest of the bag as the queue, and every placement it generates.
+struct Root_corpus {
+    State::Tetris_queue_t queue{&Block::Cyan, &Block::Red, &Block::Yellow};
+    vector<State> roots;
+    vector<State::Placement_list_t> placements;
+    vector<int> num_placements;
+    long total_placements = 0;
+
+    explicit Root_corpus(const vector<Position>& positions){
+        for(const Position& position : positions){
+            roots.push_back(State::generate_root_state(position.board, *position.block, queue, 2));
+            placements.emplace_back();
+            num_placements.push_back(roots.back().generate_ordered_placements<Standard_policy>(placements.back()));
+            total_placements += num_placements.back();
+        }
+    }
+};
+
+static Measurement time_generate_ordered_placements(const Root_corpus& corpus){
+
+    State::Placement_list_t placements;
+    return measure(static_cast<long>(corpus.roots.size()),
+        [](){},
+        [&](){
+            for(const State& root : corpus.roots){
+                checksum += root.generate_ordered_placements<Standard_policy>(placements);
+            }
+        });
+}
+
+// Every placement of every root, made then unmade. Those that do not make a child are tried all the same.
+static Measurement time_make_unmake_child(Root_corpus& corpus){
+
+    State::Undo_record undo_record;
+    return measure(corpus.total_placements,
+        [](){},
+        [&](){
+            for(size_t root_x = 0; root_x < corpus.roots.size(); ++root_x){
+                State& root = corpus.roots[root_x];
+                for(int placement_x = 0; placement_x < corpus.num_placements[root_x]; ++placement_x){
+                    if(root.make_child<Standard_policy>(corpus.placements[root_x][placement_x].placement, undo_record)){
+                        checksum += root.get_board().get_num_blocks_placed();
+                        root.unmake_child(undo_record);
+                    }
+                }
+            }
+        });
+}
+
+// Counts what it is given, and keeps none of it, so only serializing is timed.
+class Counting_buffer : public std::streambuf {
+
+public:
+
+    long num_chars = 0;
+
+protected:
+
+    int_type overflow(int_type c) override {
+        ++num_chars;
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        num_chars += count;
+        return count;
+    }
+};
+
+static Measurement time_action_serialization(const vector<Position>& positions){
+
+    Counting_buffer buffer;
+    std::ostream os{&buffer};
+    // The first action also switches targets, which only ever happens once.
+    os << Action{positions.front().block, positions.front().placement};
+
+    const Measurement measurement = measure(static_cast<long>(positions.size()),
+        [](){},
+        [&](){
+            for(const Position& position : positions){
+                os << Action{position.block, position.placement};
+            }
+        });
+    checksum += buffer.num_chars;
+    return measurement;
+}
+
+// A kernel's times over every round.
+struct Kernel_result {
+    string name;
+    // Of the rounds.
+    double median_ns_per_op;
+    // Median distance of a round from the median, as a percent of it.
+    double noise_percent;
+    double allocations_per_op;
+};
+
+static double get_median(vector<double> values){
+    std::sort(values.begin(), values.end());
+    const size_t middle_x = values.size() / 2;
+    return values.size() % 2 ? values[middle_x] : (values[middle_x - 1] + values[middle_x]) / 2;
+}
+
+static Kernel_result summarize(const string& name, const vector<Measurement>& rounds){
+    vector<double> ns_per_op;
+    for(const Measurement& round : rounds){
+        ns_per_op.push_back(round.ns_per_op);
+    }
+    const double median = get_median(ns_per_op);
+    vector<double> deviations;
+    for(double ns : ns_per_op){
+        deviations.push_back(std::abs(ns - median));
+    }
+    return Kernel_result{name, median, get_median(deviations) / median * 100, rounds.front().allocations_per_op};
+}
+
+struct Baseline_entry {
+    double ns_per_op;
+    double noise_percent;
+};
+
+// Lines of name, ns per op, and noise percent. Baselines saved before noise was measured have none.
+static map<string, Baseline_entry> read_baseline(const string& path){
+    map<string, Baseline_entry> baseline;
+    std::ifstream baseline_file{path};
+    string line;
+    while(std::getline(baseline_file, line)){
+        std::istringstream line_stream{line};
+        string name;
+        Baseline_entry entry{0, 0};
+        if(line_stream >> name >> entry.ns_per_op){
+            line_stream >> entry.noise_percent;
+            baseline[name] = entry;
+        }
+    }
+    return baseline;
+}
+
+int main(int argc, char* argv[]){
+
+    const string baseline_path = argc > 1 ? argv[1] : "bench_kernels_baseline.txt";
+    const bool save = argc > 2 && string(argv[2]) == "save";
+    const size_t num_positions = 20000;
+
+    const vector<Position> positions = make_corpus(num_positions);
+    Root_corpus root_corpus{positions};
+
+    // In the order they are reported.
+    vector<std::pair<string, function<Measurement()>>> kernels;
+    kernels.emplace_back("place_block", [&](){ return time_place_block(positions); });
+    for(int num_rows = 1; num_rows <= 4; ++num_rows){
+        kernels.emplace_back("clear_full_rows_" + std::to_string(num_rows),
+            [&positions, num_rows](){ return Kernel_bench::time_clear_full_rows(positions, num_rows); });
+    }
+    kernels.emplace_back("update_secondary_cache", [&](){ return Kernel_bench::time_update_secondary_cache(positions); });
+    kernels.emplace_back("is_promising", [&](){ return Kernel_bench::time_is_promising(positions); });
+    kernels.emplace_back("has_greater_utility_than", [&](){ return time_has_greater_utility_than(positions); });
+    kernels.emplace_back("generate_ordered_placements", [&](){ return time_generate_ordered_placements(root_corpus); });
+    kernels.emplace_back("make_unmake_child", [&](){ return time_make_unmake_child(root_corpus); });
+    kernels.emplace_back("action_serialization", [&](){ return time_action_serialization(positions); });
+
+    vector<vector<Measurement>> rounds(kernels.size());
+    for(int round_x = 0; round_x < c_num_rounds; ++round_x){
+        for(size_t kernel_x = 0; kernel_x < kernels.size(); ++kernel_x){
+            rounds[kernel_x].push_back(kernels[kernel_x].second());
+        }
+    }
+    vector<Kernel_result> results;
+    for(size_t kernel_x = 0; kernel_x < kernels.size(); ++kernel_x){
+        results.push_back(summarize(kernels[kernel_x].first, rounds[kernel_x]));
+    }
+
+    const map<string, Baseline_entry> baseline = save ? map<string, Baseline_entry>{} : read_baseline(baseline_path);
+
+    cout << "Positions: " << positions.size() << ", rounds: " << c_num_rounds << " of " << c_num_passes
+        << " passes, checksum: " << checksum << endl;
+    cout << std::left << std::setw(28) << "kernel" << std::right
+        << std::setw(10) << "ns/op" << std::setw(8) << "noise" << std::setw(14) << "ops/sec"
+        << std::setw(12) << "allocs/op" << std::setw(12) << "baseline" << std::setw(10) << "change"
+        << std::setw(11) << "threshold" << endl;
+    int num_regressions = 0;
+    for(const Kernel_result& result : results){
+        cout << std::left << std::setw(28) << result.name << std::right << std::fixed
+            << std::setw(10) << std::setprecision(2) << result.median_ns_per_op
+            << std::setw(7) << std::setprecision(1) << result.noise_percent << "%"
+            << std::setw(14) << std::setprecision(0) << 1e9 / result.median_ns_per_op
+            << std::setw(12) << std::setprecision(2) << result.allocations_per_op;
+        const auto baseline_it = baseline.find(result.name);
+        if(baseline_it != baseline.end()){
+            const Baseline_entry& entry = baseline_it->second;
+            const double change_percent = (result.median_ns_per_op / entry.ns_per_op - 1) * 100;
+            // Either run may have been the noisy one.
+            const double threshold_percent = std::max(c_min_regression_percent,
+                c_noise_multiple * std::max(result.noise_percent, entry.noise_percent));
+            cout << std::setw(12) << entry.ns_per_op
+                << std::setw(9) << std::showpos << std::setprecision(1) << change_percent << std::noshowpos << "%"
+                << std::setw(10) << threshold_percent << "%";
+            if(change_percent > threshold_percent){
+                cout << "  REGRESSION";
+                ++num_regressions;
+            }
+        }
+        cout << endl;
+    }
+
+    if(baseline.empty()){
+        std::ofstream baseline_file{baseline_path};
+        for(const Kernel_result& result : results){
+            baseline_file << result.name << " " << result.median_ns_per_op << " " << result.noise_percent << "\n";
+        }
+        cout << "Saved as the baseline in " << baseline_path << endl;
+    }
+    else if(num_regressions){
+        cout << num_regressions << " kernels slower than the baseline by more than their threshold" << endl;
+    }
+    // So make bench, and anything running it, fails on a regression.
+    return num_regressions ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+// Searches the positions of seeded games with every combination of is_promising() rules turned on or off,
+// and compares each against the search with none of them, which sees every placement.
+// Games follow the moves of the search with every rule on, which is how Jeff plays.
+// Usage: ./bench_pruning [lookahead] [queue size] [game length] [seed ...]
+
+#include "board.h"
+#include "block.h"
+#include "state.h"
+#include "engine.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::optional;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// One combination of rules, and how searching with it went.
+struct Configuration {
+    string name;
+    Pruning_rules rules;
+    // Searches with rules. Made once the configurations are settled.
+    std::shared_ptr<Engine> engine = nullptr;
+
+    long num_expanded = 0;
+    long num_leaves_scored = 0;
+    long num_considered = 0;
+    double search_ms = 0;
+    // Positions where this chose the same placement as the oracle.
+    int num_same_placement = 0;
+    // Positions where the best leaf this found was as good as the oracle's.
+    int num_same_key = 0;
+};
+
+struct Search_outcome {
+    Placement placement;
+    Utility_key key;
+};
+
+// Empty iff every placement tops out, or is pruned on the way to a leaf.
+static optional<Search_outcome> search(const Board& board, const Block& presented,
+        const State::Tetris_queue_t& queue, int lookahead, Configuration& configuration){
+
+    Engine& engine = *configuration.engine;
+    const auto start = steady_clock::now();
+    engine.distribute_new_work_and_wait_till_all_free(State::generate_root_state(board, presented, queue, lookahead));
+    configuration.search_ms += duration<double, std::milli>(steady_clock::now() - start).count();
+    const Search_counters counters = engine.get_search_counters();
+    configuration.num_expanded += counters.num_expanded;
+    configuration.num_leaves_scored += counters.num_leaves_scored;
+    configuration.num_considered += engine.get_num_states_considered();
+
+    const optional<State>& best_state = engine.get_best_reachable_state();
+    if(!best_state){
+        return {};
+    }
+    return Search_outcome{best_state->get_placement_taken_from_root(), best_state->get_board().get_utility_key()};
+}
+
+int main(int argc, char* argv[]){
+
+    const int lookahead = argc > 1 ? std::atoi(argv[1]) : 3;
+    const int queue_size = argc > 2 ? std::atoi(argv[2]) : 2;
+    const int game_length = argc > 3 ? std::atoi(argv[3]) : 40;
+    vector<Random_block_generator::Seed_t> seeds;
+    for(int arg_x = 4; arg_x < argc; ++arg_x){
+        seeds.push_back(static_cast<Random_block_generator::Seed_t>(std::atoi(argv[arg_x])));
+    }
+    if(seeds.empty()){
+        seeds = {1, 2, 3};
+    }
+
+    // Every rule on first, since games follow it. The oracle last.
+    vector<Configuration> configurations{
+        {"all", Pruning_rules{true, true}},
+        {"height only", Pruning_rules{true, false}},
+        {"holes only", Pruning_rules{false, true}},
+        {"none (oracle)", Pruning_rules{false, false}}
+    };
+    Configuration& oracle = configurations.back();
+    for(Configuration& configuration : configurations){
+        configuration.engine = std::make_shared<Engine>(1, Board_settings{Policy_id::standard, configuration.rules, nullptr});
+    }
+    int num_positions = 0;
+    for(const auto seed : seeds){
+
+        Random_block_generator block_generator{seed};
+        // Moves are made as the first configuration judges them.
+        Board board;
+        board.use_settings(configurations.front().engine->get_board_settings());
+        const Block* presented = block_generator.generate();
+        State::Tetris_queue_t queue;
+        for(int block_x = 0; block_x < queue_size; ++block_x){
+            queue.push_back(block_generator.generate());
+        }
+
+        for(int turn = 0; turn < game_length; ++turn){
+
+            board.load_ancestral_data_with_current_data();
+            // With no pruning at all, nothing reaches a leaf only if every line tops out. The game is over.
+            const optional<Search_outcome> oracle_outcome = search(board, *presented, queue, lookahead, oracle);
+            if(!oracle_outcome){
+                break;
+            }
+            // Follow the first configuration that found a move, or the oracle if none did.
+            optional<Placement> next_placement;
+            for(Configuration& configuration : configurations){
+                if(&configuration == &oracle){
+                    continue;
+                }
+                // A configuration that pruned every line found neither the same move nor as good a leaf.
+                const optional<Search_outcome> outcome =
+                    search(board, *presented, queue, lookahead, configuration);
+                if(!outcome){
+                    continue;
+                }
+                configuration.num_same_placement += outcome->placement == oracle_outcome->placement;
+                configuration.num_same_key += !(oracle_outcome->key > outcome->key);
+                if(!next_placement){
+                    next_placement = outcome->placement;
+                }
+            }
+            if(!next_placement){
+                next_placement = oracle_outcome->placement;
+            }
+            ++num_positions;
+
+            if(next_placement->get_is_hold()){
+                const Block* old_hold = board.swap_block(*presented);
+                if(old_hold){
+                    presented = old_hold;
+                    continue;
+                }
+            }
+            else if(!board.place_block(*presented, *next_placement)){
+                break;
+            }
+            presented = queue.front();
+            queue.pop_front();
+            queue.push_back(block_generator.generate());
+        }
+    }
+    oracle.num_same_placement = oracle.num_same_key = num_positions;
+
+    cout << "Positions: " << num_positions << " from " << seeds.size() << " games, lookahead: " << lookahead
+        << ", queue size: " << queue_size << endl;
+    cout << std::left << std::setw(16) << "pruning" << std::right
+        << std::setw(12) << "expanded" << std::setw(12) << "leaves" << std::setw(14) << "considered"
+        << std::setw(12) << "ms/move" << std::setw(14) << "same move %" << std::setw(14) << "same key %" << endl;
+    cout << std::fixed;
+    for(const Configuration& configuration : configurations){
+        cout << std::left << std::setw(16) << configuration.name << std::right << std::setprecision(0)
+            << std::setw(12) << static_cast<double>(configuration.num_expanded) / num_positions
+            << std::setw(12) << static_cast<double>(configuration.num_leaves_scored) / num_positions
+            << std::setw(14) << static_cast<double>(configuration.num_considered) / num_positions
+            << std::setprecision(3) << std::setw(12) << configuration.search_ms / num_positions
+            << std::setprecision(1)
+            << std::setw(14) << 100.0 * configuration.num_same_placement / num_positions
+            << std::setw(14) << 100.0 * configuration.num_same_key / num_positions << endl;
+    }
+    cout << "Per move averages. Same key: the best leaf was as good as the oracle's, though the move may differ." << endl;
+    return 0;
+}
@@ -0,0 +1,205 @@
+// How good a move the search finds under increasing time and node budgets, against the move it finds unlimited.
+// Takes the same settings as main, and plays one game of game length moves from the seed, following the unlimited
+// search, which is the oracle. Every position is searched again under each budget.
+// Writes the quality curve to quality_curve.csv as well.
+// Usage: ./bench_quality <main's settings>, for example: ./bench_quality w 1 5 4 30 1 n
+
+#include "board.h"
+#include "block.h"
+#include "state.h"
+#include "engine.h"
+#include "play_settings.h"
+#include "player.h"
+#include "learned_evaluator.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::optional;
+
+// A search limit, and how moves found under it compare with the oracle's.
+struct Budget {
+    string name;
+    int deadline_ms;
+    long node_budget;
+
+    double search_ms = 0;
+    long states_considered = 0;
+    long depth_reached = 0;
+    int num_same_placement = 0;
+    // Positions where the placement was as good as the oracle's, though it may differ.
+    int num_same_utility = 0;
+    // Over placements worse than the oracle's, bits in the primary word of the utility key lost.
+    // A loss in a more significant field of the key loses more bits.
+    long primary_bits_lost = 0;
+};
+
+// Greatest utility key of any leaf below placement, searching only as deep as the queue shows.
+// Exact for any placement, which the search's own keys are only for the one it chose.
+static Utility_key get_best_key_after(Engine& engine, Board board, const Block& presented,
+        const State::Tetris_queue_t& queue, int lookahead, Placement placement){
+
+    board.load_ancestral_data_with_current_data();
+    State root = State::generate_root_state(board, presented, queue, lookahead);
+    optional<State> child = root.generate_child_from_placement(placement);
+    if(child->get_is_leaf()){
+        return child->get_board().get_utility_key();
+    }
+    engine.distribute_new_work_and_wait_till_all_free(std::move(*child));
+    // Every line below placement tops out. Nothing is worse.
+    const optional<State>& best_state = engine.get_best_reachable_state();
+    return best_state ? best_state->get_board().get_utility_key() : Utility_key{};
+}
+
+static int get_bit_length(std::uint64_t value){
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+int main(int argc, char* argv[]){
+
+    Play_settings settings(argc, argv);
+    Board_settings board_settings{settings.policy, settings.pruning_rules, nullptr};
+    optional<Learned_evaluator> learned_evaluator;
+    if(settings.evaluator == Evaluator::learned){
+        learned_evaluator.emplace(settings.weights);
+        board_settings.learned_evaluator = &*learned_evaluator;
+    }
+
+    Play_settings oracle_settings = settings;
+    oracle_settings.deadline_ms = 0;
+    oracle_settings.node_budget = 0;
+
+    vector<Budget> budgets;
+    for(int deadline_ms : {1, 2, 5, 10, 20, 50, 100}){
+        budgets.push_back(Budget{std::to_string(deadline_ms) + " ms", deadline_ms, 0});
+    }
+    for(long node_budget : {1000, 3000, 10000, 30000, 100000, 300000}){
+        budgets.push_back(Budget{std::to_string(node_budget) + " states", 0, node_budget});
+    }
+
+    Player player{settings, board_settings};
+    // Utility is compared over the placements the queue shows, without the chance layer or rollouts.
+    const int static_lookahead = std::min(settings.lookahead_placements, settings.queue_size + 1);
+
+    Random_block_generator block_generator{settings.seed};
+    Bag_tracker bag_tracker;
+    const auto generate = [&block_generator, &bag_tracker](){
+        const Block* b = block_generator.generate();
+        bag_tracker.observe(*b);
+        return b;
+    };
+    // Judged as the searches judge it, so following the oracle's placement is promising.
+    Board board;
+    board.use_settings(player.engine.get_board_settings());
+    const Block* presented = generate();
+    State::Tetris_queue_t queue;
+    for(int block_x = 0; block_x < settings.queue_size; ++block_x){
+        queue.push_back(generate());
+    }
+
+    Budget oracle{"oracle", 0, 0};
+    int num_positions = 0;
+    for(int turn = 0; turn < settings.game_length; ++turn){
+
+        // As get_best_move() does, so following the oracle's placement is promising.
+        board.load_ancestral_data_with_current_data();
+        Board search_board = board;
+        const optional<Search_result> oracle_move = get_best_move(
+            player, search_board, *presented, queue, bag_tracker.get_possible_next(), oracle_settings, {});
+        if(!oracle_move){
+            break;
+        }
+        const Search_result& oracle_result = *oracle_move;
+        oracle.search_ms += oracle_result.time_used.count() / 1000.0;
+        oracle.states_considered += oracle_result.states_considered;
+        oracle.depth_reached += oracle_result.depth_reached;
+        const Utility_key oracle_key =
+            get_best_key_after(player.engine, board, *presented, queue, static_lookahead, oracle_result.placement);
+
+        for(Budget& budget : budgets){
+            Play_settings budget_settings = settings;
+            budget_settings.deadline_ms = budget.deadline_ms;
+            budget_settings.node_budget = budget.node_budget;
+            search_board = board;
+            // The oracle found a move, so the first search, which has no limits, finds one too.
+            const Search_result result = *get_best_move(
+                player, search_board, *presented, queue, bag_tracker.get_possible_next(), budget_settings, {});
+            budget.search_ms += result.time_used.count() / 1000.0;
+            budget.states_considered += result.states_considered;
+            budget.depth_reached += result.depth_reached;
+            if(result.placement == oracle_result.placement){
+                ++budget.num_same_placement;
+                ++budget.num_same_utility;
+                continue;
+            }
+            const Utility_key key =
+                get_best_key_after(player.engine, board, *presented, queue, static_lookahead, result.placement);
+            if(!(oracle_key > key)){
+                ++budget.num_same_utility;
+            }
+            else if(oracle_key.primary > key.primary){
+                budget.primary_bits_lost += get_bit_length(oracle_key.primary - key.primary);
+            }
+        }
+        ++num_positions;
+
+        // Follow the oracle.
+        if(oracle_result.placement.get_is_hold()){
+            const Block* old_hold = board.swap_block(*presented);
+            if(old_hold){
+                presented = old_hold;
+                continue;
+            }
+        }
+        else if(!board.place_block(*presented, oracle_result.placement)){
+            break;
+        }
+        presented = queue.front();
+        queue.pop_front();
+        queue.push_back(generate());
+    }
+    oracle.num_same_placement = oracle.num_same_utility = num_positions;
+
+    std::ofstream csv{"quality_curve.csv"};
+    csv << "budget,deadline_ms,node_budget,ms_per_move,states_per_move,mean_depth,same_move_percent,"
+        "same_utility_percent,mean_primary_bits_lost\n";
+    cout << "Positions: " << num_positions << ", lookahead: " << settings.lookahead_placements
+        << ", queue size: " << settings.queue_size << endl;
+    cout << std::left << std::setw(16) << "budget" << std::right << std::setw(12) << "ms/move"
+        << std::setw(14) << "states/move" << std::setw(8) << "depth" << std::setw(14) << "same move %"
+        << std::setw(16) << "same utility %" << std::setw(12) << "bits lost" << endl;
+    budgets.push_back(oracle);
+    for(const Budget& budget : budgets){
+        const int num_worse = num_positions - budget.num_same_utility;
+        const double ms_per_move = budget.search_ms / num_positions;
+        const double states_per_move = static_cast<double>(budget.states_considered) / num_positions;
+        const double mean_depth = static_cast<double>(budget.depth_reached) / num_positions;
+        const double same_move_percent = 100.0 * budget.num_same_placement / num_positions;
+        const double same_utility_percent = 100.0 * budget.num_same_utility / num_positions;
+        const double mean_bits_lost = num_worse ? static_cast<double>(budget.primary_bits_lost) / num_worse : 0;
+
+        csv << budget.name << "," << budget.deadline_ms << "," << budget.node_budget << "," << ms_per_move << ","
+            << states_per_move << "," << mean_depth << "," << same_move_percent << "," << same_utility_percent << ","
+            << mean_bits_lost << "\n";
+        cout << std::left << std::setw(16) << budget.name << std::right << std::fixed
+            << std::setprecision(3) << std::setw(12) << ms_per_move
+            << std::setprecision(0) << std::setw(14) << states_per_move
+            << std::setprecision(2) << std::setw(8) << mean_depth
+            << std::setprecision(1) << std::setw(14) << same_move_percent << std::setw(16) << same_utility_percent
+            << std::setw(12) << mean_bits_lost << endl;
+    }
+    cout << "Bits lost: over moves worse than the oracle's, how far up the utility key the loss reached." << endl;
+    cout << "Written to quality_curve.csv" << endl;
+
+    delete settings.block_generator;
+    return 0;
+}
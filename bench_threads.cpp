@@ -0,0 +1,172 @@
+// Searches the same positions with 1, 2, ... max threads, and writes how well the workers scale as CSV.
+// Usage: ./bench_threads [max threads] [lookahead] [num positions] [csv file]
+
+#include "board.h"
+#include "block.h"
+#include "state.h"
+#include "engine.h"
+#include "rollout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+
+// A position Jeff could be asked to search.
+struct Position {
+    Board board;
+    const Block* presented;
+    State::Tetris_queue_t queue;
+};
+
+static const int c_queue_size = 6;
+// Placements between positions, so they differ.
+static const int c_placements_between_positions = 7;
+
+// Positions from one greedy game, dealt by a seeded bag, restarted whenever it tops out.
+static vector<Position> make_positions(int num_positions){
+
+    Random_block_generator block_generator{1};
+    State::Tetris_queue_t queue;
+    for(int block_x = 0; block_x < c_queue_size + 1; ++block_x){
+        queue.push_back(block_generator.generate());
+    }
+
+    vector<Position> positions;
+    Board board;
+    for(int placement_x = 1; static_cast<int>(positions.size()) < num_positions; ++placement_x){
+        board.load_ancestral_data_with_current_data();
+        if(!place_greedily(board, *queue.front())){
+            board = Board{};
+        }
+        queue.pop_front();
+        queue.push_back(block_generator.generate());
+        if(placement_x % c_placements_between_positions == 0){
+            positions.push_back(Position{board, queue.front(), State::Tetris_queue_t(queue.begin() + 1, queue.end())});
+        }
+    }
+    return positions;
+}
+
+// Everything measured searching every position with some number of threads.
+struct Scaling_result {
+    int num_threads = 0;
+    double wall_ms = 0;
+    long nodes = 0;
+    vector<Worker_scheduling_stats> worker_stats;
+};
+
+static void search(Engine& engine, const Position& position, int lookahead){
+    Board board = position.board;
+    board.load_ancestral_data_with_current_data();
+    engine.distribute_new_work_and_wait_till_all_free(
+        State::generate_root_state(board, *position.presented, position.queue, lookahead));
+}
+
+static Scaling_result measure(int num_threads, const vector<Position>& positions, int lookahead){
+
+    Engine engine{num_threads};
+    // Warm up the arenas and deques, so their first allocations are not timed.
+    search(engine, positions.front(), lookahead);
+
+    Scaling_result result;
+    result.num_threads = num_threads;
+    result.worker_stats.resize(num_threads);
+    for(const Position& position : positions){
+        const auto start = steady_clock::now();
+        search(engine, position, lookahead);
+        result.wall_ms += duration<double, std::milli>(steady_clock::now() - start).count();
+        result.nodes += engine.get_num_states_considered();
+
+        const vector<Worker_scheduling_stats> worker_stats = engine.get_scheduling_stats();
+        for(int worker_x = 0; worker_x < num_threads; ++worker_x){
+            Worker_scheduling_stats& total = result.worker_stats[worker_x];
+            total.num_states_shared += worker_stats[worker_x].num_states_shared;
+            total.num_steals += worker_stats[worker_x].num_steals;
+            total.num_lost_steal_races += worker_stats[worker_x].num_lost_steal_races;
+            total.idle_time += worker_stats[worker_x].idle_time;
+            total.lock_wait_time += worker_stats[worker_x].lock_wait_time;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]){
+
+    const int max_threads = argc > 1 ? std::atoi(argv[1])
+        : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int lookahead = argc > 2 ? std::atoi(argv[2]) : 4;
+    const int num_positions = argc > 3 ? std::atoi(argv[3]) : 20;
+    const string csv_path = argc > 4 ? argv[4] : "thread_scaling.csv";
+
+    const vector<Position> positions = make_positions(num_positions);
+
+    std::ofstream csv{csv_path};
+    if(!csv){
+        std::cerr << "Cannot write " << csv_path << endl;
+        return 1;
+    }
+    csv << "threads,wall_ms,nodes,nodes_per_sec,speedup,efficiency,states_shared,steals,lost_steal_races,"
+        "lock_wait_us,idle_ms_mean,idle_ms_max,idle_ms_per_worker\n";
+
+    cout << "Positions: " << positions.size() << ", lookahead: " << lookahead
+        << ", hardware threads: " << std::thread::hardware_concurrency() << endl;
+    cout << std::setw(8) << "threads" << std::setw(12) << "wall ms" << std::setw(14) << "nodes/sec"
+        << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::setw(10) << "steals"
+        << std::setw(14) << "idle ms mean" << endl;
+
+    double one_thread_wall_ms = 0;
+    for(int num_threads = 1; num_threads <= max_threads; ++num_threads){
+
+        const Scaling_result result = measure(num_threads, positions, lookahead);
+        if(num_threads == 1){
+            one_thread_wall_ms = result.wall_ms;
+        }
+        const double nodes_per_sec = result.nodes / result.wall_ms * 1000;
+        const double speedup = one_thread_wall_ms / result.wall_ms;
+        const double efficiency = speedup / num_threads;
+
+        long states_shared = 0;
+        long steals = 0;
+        long lost_steal_races = 0;
+        double lock_wait_us = 0;
+        double idle_ms_max = 0;
+        double idle_ms_total = 0;
+        string idle_ms_per_worker;
+        for(const Worker_scheduling_stats& stats : result.worker_stats){
+            states_shared += stats.num_states_shared;
+            steals += stats.num_steals;
+            lost_steal_races += stats.num_lost_steal_races;
+            lock_wait_us += duration<double, std::micro>(stats.lock_wait_time).count();
+            const double idle_ms = duration<double, std::milli>(stats.idle_time).count();
+            idle_ms_total += idle_ms;
+            idle_ms_max = std::max(idle_ms_max, idle_ms);
+            idle_ms_per_worker += (idle_ms_per_worker.empty() ? "" : ";") + std::to_string(idle_ms);
+        }
+        const double idle_ms_mean = idle_ms_total / num_threads;
+
+        csv << num_threads << "," << result.wall_ms << "," << result.nodes << "," << nodes_per_sec << ","
+            << speedup << "," << efficiency << "," << states_shared << "," << steals << "," << lost_steal_races << ","
+            << lock_wait_us << "," << idle_ms_mean << "," << idle_ms_max << "," << idle_ms_per_worker << "\n";
+
+        cout << std::fixed << std::setprecision(2)
+            << std::setw(8) << num_threads << std::setw(12) << result.wall_ms
+            << std::setw(14) << std::setprecision(0) << nodes_per_sec
+            << std::setw(10) << std::setprecision(2) << speedup << std::setw(12) << efficiency
+            << std::setw(10) << steals << std::setw(14) << idle_ms_mean << endl;
+    }
+    cout << "Written to " << csv_path << endl;
+    return 0;
+}
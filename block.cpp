@@ -1,73 +1,18 @@
 #include "block.h"
 
-#include "board.h"  // access in get_max_valid_placement_col
-
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <array>
+#include <string>
 
+using std::array;
 using std::shuffle;
 using std::string;
 using std::vector;
 using std::cin;
 using std::runtime_error;
 
-const Block* Block::char_to_block_ptr(char c){
-
-    switch(c){
-        case 'b' : return &Blue;
-        case 'p' : return &Purple;
-        case 'r' : return &Red;
-        case 'c' : return &Cyan;
-        case 'y' : return &Yellow;
-        case 'o' : return &Orange;
-        case 'g' : return &Green;
-        default : throw std::runtime_error{
-            "Invalid Block! "
-            + string{c}
-            + " Must be one of: b, p, r, c, y, o, g."
-        };
-    }
-}
-
-const char Block::block_ptr_to_char(const Block* block){
-
-    if(block == &Blue){
-        return 'b';
-    }
-    if(block == &Purple){
-        return 'p';
-    }
-    if(block == &Red){
-        return 'r';
-    }
-    if(block == &Cyan){
-        return 'c';
-    }
-    if(block == &Yellow){
-        return 'y';
-    }
-    if(block == &Orange){
-        return 'o';
-    }
-    if(block == &Green){
-        return 'g';
-    }
-
-    throw std::runtime_error{"Invalid block pointer!"};
-}
-
-int Block::get_max_valid_placement_col(int rot_x) const {
-    return Board::c_cols - maps[rot_x].contour.size();
-}
-
-Block::Block(const string& _name, const vector<CH_maps>& _maps)
-    : name{_name}, maps{_maps} {
-
-    safe_left_trans = maps[0].leftmost_block_pos;
-    safe_right_trans = Board::c_cols - (maps[0].leftmost_block_pos + maps[0].contour.size());
-}
-
 // === Block Generators ===
 
 const Block* Stdin_block_generator::generate() {
@@ -83,8 +28,8 @@ Random_block_generator::Random_block_generator(Seed_t seed)
 const Block* Random_block_generator::generate() {
 
     if(bag_instance.empty()){
-        shuffle(full_bag.begin(), full_bag.end(), generator);
-        for(const auto& b : full_bag){
+        shuffle(bag.begin(), bag.end(), generator);
+        for(const auto& b : bag){
             bag_instance.push(b);
         }
     }
@@ -93,7 +38,22 @@ const Block* Random_block_generator::generate() {
     return block;
 }
 
-vector<const Block*> Random_block_generator::full_bag {
+// === Bag Tracker ===
+
+void Bag_tracker::observe(const Block& b){
+
+    const std::uint8_t bit = static_cast<std::uint8_t>(1u << b.index);
+    // Dealt twice in one bag, so the bag we assumed was not the real one. This block starts a new one.
+    if(!(remaining & bit)){
+        remaining = c_full_bag;
+    }
+    remaining &= ~bit;
+    if(!remaining){
+        remaining = c_full_bag;
+    }
+}
+
+const vector<const Block*> Random_block_generator::full_bag {
     &Block::Cyan, &Block::Blue, &Block::Orange,
     &Block::Green, &Block::Red, &Block::Yellow, &Block::Purple
 };
@@ -107,7 +67,7 @@ XX
 contour: 0, -1, -1
 height: 1, 2, 1
 */
-const Block Block::Blue {"Blue", {
+constexpr Block Block::Blue {"Blue", 'b', 0, {
     // X
     // XXX
     { {0, 0, 0}, {2, 1, 1}, 3},
@@ -127,7 +87,7 @@ const Block Block::Blue {"Blue", {
     { {0, 0}, {1, 3}, 3},
 }};
 
-const Block Block::Purple {"Purple", {
+constexpr Block Block::Purple {"Purple", 'p', 1, {
 
     //  X
     // XXX
@@ -148,7 +108,7 @@ const Block Block::Purple {"Purple", {
     { {0, -1}, {1, 3}, 3},
 }};
 
-const Block Block::Red {"Red", {
+constexpr Block Block::Red {"Red", 'r', 2, {
     // XX
     //  XX
     { {0, -1, -1}, {1, 2, 1}, 3},
@@ -159,7 +119,7 @@ const Block Block::Red {"Red", {
     { {0, 1}, {2, 2}, 4},
 }};
 
-const Block Block::Cyan {"Cyan", {
+constexpr Block Block::Cyan {"Cyan", 'c', 3, {
     // XXXX
     {
         {0, 0, 0, 0}, // Contour
@@ -177,13 +137,13 @@ const Block Block::Cyan {"Cyan", {
     },
 }};
 
-const Block Block::Yellow {"Yellow", {
+constexpr Block Block::Yellow {"Yellow", 'y', 4, {
     // XX
     // XX
     { {0, 0}, {2, 2}, 4 },
 }};
 
-const Block Block::Orange {"Orange", {
+constexpr Block Block::Orange {"Orange", 'o', 5, {
 
     //   X
     // XXX
@@ -205,7 +165,7 @@ const Block Block::Orange {"Orange", {
 
 }};
 
-const Block Block::Green {"Green", {
+constexpr Block Block::Green {"Green", 'g', 6, {
 
     //  XX
     // XX
@@ -216,3 +176,46 @@ const Block Block::Green {"Green", {
     //  X
     { {0, -1}, {2, 2}, 4},
 }};
+
+// === Lookup Tables ===
+
+constexpr array<const Block*, Block::c_num_blocks> Block::all_blocks {
+    &Blue, &Purple, &Red, &Cyan, &Yellow, &Orange, &Green
+};
+
+static constexpr array<const Block*, 128> make_letter_to_block(){
+    array<const Block*, 128> table{};
+    for(const Block* block : Block::all_blocks){
+        table[block->letter] = block;
+    }
+    return table;
+}
+
+// Indexed by letter. nullptr for letters that are not blocks.
+static constexpr array<const Block*, 128> letter_to_block = make_letter_to_block();
+
+// === Conversions ===
+
+const Block* Block::char_to_block_ptr(char c){
+
+    const Block* block = nullptr;
+    if(c >= 0 && static_cast<size_t>(c) < letter_to_block.size()){
+        block = letter_to_block[c];
+    }
+    if(!block){
+        throw std::runtime_error{
+            "Invalid Block! "
+            + string{c}
+            + " Must be one of: b, p, r, c, y, o, g."
+        };
+    }
+    return block;
+}
+
+char Block::block_ptr_to_char(const Block* block){
+
+    if(!block){
+        throw std::runtime_error{"Invalid block pointer!"};
+    }
+    return block->letter;
+}
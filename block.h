@@ -1,18 +1,59 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
-#include <string>
+#include "board.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <queue>
 #include <cassert>
 #include <random>
 
 // For every shape block, and for every rotation, one of these exists to descripe the shape of the block in that orientation.
+// Entirely computed at compile time.
 struct CH_maps {
-    std::vector<int> contour;
-    std::vector<int> height;
+
+    static constexpr int c_max_width = 4;
+    // Contours range from -2 to 2. Rows in row_masks are offset by this much so they are nonnegative.
+    static constexpr int c_row_bias = 2;
+    static constexpr int c_max_rows = 8;
+
+    // Only the first width entries are meaningful.
+    std::array<int, c_max_width> contour = {0};
+    std::array<int, c_max_width> height = {0};
+    int width = 0;
     // TODO: Should rename struct now that this was added.
-    int leftmost_block_pos;
+    int leftmost_block_pos = 0;
+
+    // Largest column the left side of the block can be placed at.
+    int max_valid_col = 0;
+
+    // row_masks[r] holds the cells of row (landing row + r - c_row_bias) when placed at column 0.
+    // Shift left by the placement column to place elsewhere.
+    std::array<std::uint16_t, c_max_rows> row_masks = {0};
+    // Range of r in row_masks that has any cells.
+    int lowest_mask_row = c_max_rows;
+    int highest_mask_row = 0;
+
+    template <std::size_t Width>
+    constexpr CH_maps(const int (&_contour)[Width], const int (&_height)[Width], int _leftmost_block_pos)
+        : width{static_cast<int>(Width)}, leftmost_block_pos{_leftmost_block_pos},
+        max_valid_col{static_cast<int>(Board::c_cols - Width)} {
+
+        static_assert(Width >= 1 && Width <= c_max_width, "Blocks are 1 to 4 wide.");
+        for(std::size_t contour_x = 0; contour_x < Width; ++contour_x){
+            contour[contour_x] = _contour[contour_x];
+            height[contour_x] = _height[contour_x];
+            const int start_row = _contour[contour_x] + c_row_bias;
+            for(int row = start_row; row < start_row + _height[contour_x]; ++row){
+                row_masks[row] |= static_cast<std::uint16_t>(1u << contour_x);
+                lowest_mask_row = row < lowest_mask_row ? row : lowest_mask_row;
+                highest_mask_row = row > highest_mask_row ? row : highest_mask_row;
+            }
+        }
+    }
 };
 
 // Represents something a player can do with a block. Hold the block, or place it at a certain position with a certain rotation.
@@ -38,6 +79,10 @@ public:
         return is_hold;
     }
 
+    bool operator==(const Placement& other) const {
+        return rotation == other.rotation && column == other.column && is_hold == other.is_hold;
+    }
+
 private:
     int rotation;
     int column;
@@ -47,11 +92,21 @@ private:
 // Exactly one instance for every type of block (tetrimino)
 struct Block {
 
-    std::string name;
+    static constexpr int c_num_blocks = 7;
+    static constexpr int c_max_rotations = 4;
+
+    const char* name;
+
+    // What the eyes call this block.
+    char letter;
+
+    // Unique in [0, c_num_blocks).
+    int index;
 
     // maps[rotation idx] = maps for that rotation
-    // size = number of possible rotations.
-    std::vector<CH_maps> maps;
+    // Only the first num_rotations are meaningful.
+    std::array<CH_maps, c_max_rotations> maps;
+    int num_rotations;
 
     // After this many translations, the piece will be against the wall (while in rotation 0)
     int safe_left_trans;
@@ -65,10 +120,24 @@ struct Block {
     static const Block Orange;
     static const Block Green;
 
+    // Indexed by index.
+    static const std::array<const Block*, c_num_blocks> all_blocks;
+
     static const Block* char_to_block_ptr(char c);
-    static const char block_ptr_to_char(const Block* block);
+    static char block_ptr_to_char(const Block* block);
+
+    int get_max_valid_placement_col(int rot_x) const {
+        return maps[rot_x].max_valid_col;
+    }
 
-    int get_max_valid_placement_col(int rot_x) const;
+    // Columns of every rotation this block could be dropped at.
+    int get_num_drop_placements() const {
+        int num_drop_placements = 0;
+        for(int rot_x = 0; rot_x < num_rotations; ++rot_x){
+            num_drop_placements += get_max_valid_placement_col(rot_x) + 1;
+        }
+        return num_drop_placements;
+    }
 
     Block& operator=(const Block& other) = delete;
     Block& operator=(Block&& other) = delete;
@@ -77,7 +146,16 @@ struct Block {
     Block(Block&& other) = delete;
 
 private:
-    Block(const std::string& _name, const std::vector<CH_maps>& _maps);
+    template <std::size_t Num_rotations>
+    constexpr Block(const char* _name, char _letter, int _index, const CH_maps (&_maps)[Num_rotations])
+        : name{_name}, letter{_letter}, index{_index},
+        maps{_maps[0], _maps[Num_rotations > 1 ? 1 : 0], _maps[Num_rotations > 2 ? 2 : 0], _maps[Num_rotations > 3 ? 3 : 0]},
+        num_rotations{static_cast<int>(Num_rotations)},
+        safe_left_trans{_maps[0].leftmost_block_pos},
+        safe_right_trans{static_cast<int>(Board::c_cols) - (_maps[0].leftmost_block_pos + _maps[0].width)} {
+
+        static_assert(Num_rotations >= 1 && Num_rotations <= c_max_rotations, "Blocks have 1 to 4 rotations.");
+    }
 };
 
 class Block_generator{
@@ -107,11 +185,32 @@ public:
 
 private:
 
-    static std::vector<const Block*> full_bag;
+    static const std::vector<const Block*> full_bag;
 
+    // Shuffled by this generator only, so generators dealing at once do not deal each other's blocks.
+    std::vector<const Block*> bag = full_bag;
     std::queue<const Block*> bag_instance;
     std::default_random_engine generator;
 };
 
+// Follows which blocks the 7-bag randomizer can still deal before it refills.
+// Assumes the first block observed starts a bag. Resyncs on a block its bag has already dealt.
+class Bag_tracker {
+
+public:
+
+    static constexpr std::uint8_t c_full_bag = (1u << Block::c_num_blocks) - 1;
+
+    void observe(const Block& b);
+
+    // Bit block.index is set iff that block could be dealt after everything observed.
+    std::uint8_t get_possible_next() const {
+        return remaining;
+    }
+
+private:
+
+    std::uint8_t remaining = c_full_bag;
+};
 
 #endif
\ No newline at end of file
@@ -2,7 +2,7 @@
 
 #include "block.h"
 #include "utility.h"
-#include "global_stats.h"
+#include "learned_evaluator.h"
 
 #include <algorithm>
 #include <cassert>
@@ -10,10 +10,62 @@
 #include <utility>
 #include <numeric>
 #include <iostream>
+#include <type_traits>
+#include <cstring>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // TODO: Replace with individual using statements
 using namespace std;
 
+// Lifetime counts past this many bits all tie in the key.
+static constexpr int c_utility_count_bits = 16;
+
+// === Zobrist keys ===
+
+struct Zobrist_keys {
+    array<uint64_t, Board::c_size> cells;
+    // Indexed by block index + 1. 0 is no hold and does not change the hash.
+    array<uint64_t, Block::c_num_blocks + 1> hold;
+    uint64_t just_swapped;
+};
+
+static constexpr Zobrist_keys make_zobrist_keys(){
+    Zobrist_keys keys{};
+    uint64_t seed = 0;
+    for(auto& key : keys.cells){
+        key = mix_bits(++seed);
+    }
+    for(size_t block_x = 1; block_x < keys.hold.size(); ++block_x){
+        keys.hold[block_x] = mix_bits(++seed);
+    }
+    keys.just_swapped = mix_bits(++seed);
+    return keys;
+}
+
+static constexpr Zobrist_keys c_zobrist_keys = make_zobrist_keys();
+
+static uint64_t hold_key(const Block* hold){
+    return c_zobrist_keys.hold[hold ? hold->index + 1 : 0];
+}
+
+// Calls func with the width of a block rotation as a compile time constant,
+// so that loops over the contour are fully unrolled.
+template <typename Func>
+static auto dispatch_on_width(int width, Func&& func){
+    switch(width){
+        case 1: return func(integral_constant<int, 1>{});
+        case 2: return func(integral_constant<int, 2>{});
+        case 3: return func(integral_constant<int, 3>{});
+        default:
+            assert(width == 4);
+            return func(integral_constant<int, 4>{});
+    }
+}
+
 Board::Board(istream& is){
 
     string label;
@@ -23,7 +75,9 @@ Board::Board(istream& is){
         for(size_t col_x = 0; col_x < c_cols; ++col_x){
             char cell;
             is >> cell;
-            at(static_cast<size_t>(row_x), col_x) = (cell == 'x');
+            if(cell == 'x'){
+                board[row_x] |= static_cast<Row_t>(1u << col_x);
+            }
         }
     }
 
@@ -41,26 +95,67 @@ Board::Board(istream& is){
     is >> just_swapped_str;
     just_swapped = (just_swapped_str == "true");
 
+    zobrist_hash = compute_zobrist_hash();
+
     // Update things that cache does not do.
     for(size_t col_x = 0; col_x < c_cols; ++col_x){
         int height = compute_height(col_x);
         height_map[col_x] = height;
         perfect_num_cells_filled += height;
     }
-    num_cells_filled = board.count();
+    for(Row_t row : board){
+        num_cells_filled += __builtin_popcount(row);
+    }
 
-    update_secondary_cache(0);
+    update_secondary_cache();
     load_ancestral_data_with_current_data();
 
 }
 
+Board::Board(const Packed& packed, const Board_settings& _settings)
+    : settings{&_settings} {
+
+    for(size_t row_x = 0; row_x < c_rows; ++row_x){
+        const int shift = c_cols * (row_x % c_rows_per_packed_word);
+        board[row_x] = static_cast<Row_t>((packed.grid[row_x / c_rows_per_packed_word] >> shift) & c_full_row);
+    }
+
+    current_hold = packed.hold ? Block::all_blocks[packed.hold - 1] : nullptr;
+    just_swapped = packed.just_swapped;
+    zobrist_hash = compute_zobrist_hash();
+
+    // Walk down, so each column's height is set by the first filled cell seen in it.
+    Row_t seen_cols = 0;
+    for(int row_x = c_rows - 1; row_x >= 0; --row_x){
+        for(Row_t new_cols = board[row_x] & ~seen_cols; new_cols; new_cols &= new_cols - 1){
+            height_map[__builtin_ctz(new_cols)] = row_x + 1;
+            perfect_num_cells_filled += row_x + 1;
+        }
+        seen_cols |= board[row_x];
+        num_cells_filled += __builtin_popcount(board[row_x]);
+    }
+
+    lifetime_stats.num_blocks_placed = packed.num_blocks_placed;
+    lifetime_stats.num_placements_that_cleared_rows = packed.num_placements_that_cleared_rows;
+    lifetime_stats.num_tetrises = packed.num_tetrises;
+    lifetime_stats.num_non_tetrises = packed.num_non_tetrises;
+    lifetime_stats.num_all_clears = packed.num_all_clears;
+    lifetime_stats.max_height_exp_moving_average = packed.max_height_exp_moving_average;
+
+    update_secondary_cache();
+    // Packed ancestral data wins over anything update_secondary_cache() loaded.
+    ancestor_with_smallest_max_height.highest_height = packed.ancestor_highest_height;
+    ancestor_with_smallest_max_height.second_lowest_height = packed.ancestor_second_lowest_height;
+    ancestor_with_smallest_max_height.good_trench_status = packed.ancestor_good_trench_status;
+}
+
 ostream& operator<<(ostream& os, const Board& s) {
 
     os << "Holding: ";
     os << (s.current_hold ? s.current_hold->name : "none") << "\n";
 
     for(long row = Board::c_rows - 1; row >= 0; --row){
-        for(long col = 0; col < Board::c_cols; ++col){
+        for(long col = 0; col < static_cast<long>(Board::c_cols); ++col){
             os << (s.at(row, col) ? "X" : ".");
         }
         os << "\n";
@@ -74,68 +169,281 @@ ostream& operator<<(ostream& os, const Board& s) {
 }
 
 // Return true iff this board is still promising.
+template <class Policy>
 bool Board::place_block(const Block& b, Placement p){
+    uint32_t cleared_rows;
+    return place_block<Policy>(b, p, get_row_after_drop(b, p), cleared_rows);
+}
 
-    assert(!p.get_is_hold());
+bool Board::place_block(const Block& b, Placement p){
+    return dispatch_on_policy(settings->policy, [&](auto policy){
+        return place_block<decltype(policy)>(b, p);
+    });
+}
 
-    const int left_bottom_row = get_row_after_drop(b, p);
+template <class Policy>
+bool Board::place_block(const Block& b, Placement p, Undo_record& undo_record){
+    save_for_undo(undo_record);
+    undo_record.block = &b;
+    undo_record.rotation = p.get_rotation();
+    undo_record.column = p.get_column();
+    undo_record.left_bottom_row = get_row_after_drop(b, p);
+    undo_record.cleared_rows = 0;
+    return place_block<Policy>(b, p, undo_record.left_bottom_row, undo_record.cleared_rows);
+}
 
-    const CH_maps& ch_map = b.maps[p.get_rotation()];
-    const int contour_size = ch_map.contour.size();
+bool Board::place_block(const Block& b, Placement p, Undo_record& undo_record){
+    return dispatch_on_policy(settings->policy, [&](auto policy){
+        return place_block<decltype(policy)>(b, p, undo_record);
+    });
+}
 
-    int min_row_x_affected = c_rows - 1;
-    int max_row_x_affected = 0;
+template <class Policy>
+bool Board::place_block(const Block& b, Placement p, int left_bottom_row, uint32_t& cleared_rows){
 
-    for(int contour_x = 0; contour_x < contour_size; ++contour_x){
-        const int col = p.get_column() + contour_x;
-        const int abs_start_fill_row = left_bottom_row + ch_map.contour[contour_x];
-        const int abs_end_fill_row = abs_start_fill_row + ch_map.height[contour_x];
+    assert(!p.get_is_hold());
 
-        min_row_x_affected = min(min_row_x_affected, abs_start_fill_row);
-        max_row_x_affected = max(max_row_x_affected, abs_end_fill_row - 1);
+    const CH_maps& ch_map = b.maps[p.get_rotation()];
+    const int mask_row_offset = left_bottom_row - CH_maps::c_row_bias;
 
-        if(max_row_x_affected >= c_rows){
-            // NOTE: If we're here, this state is never touched again.
-            // Because its game over.
-            return false;
-        }
+    const int min_row_x_affected = mask_row_offset + ch_map.lowest_mask_row;
+    const int max_row_x_affected = mask_row_offset + ch_map.highest_mask_row;
 
-        perfect_num_cells_filled -= height_map[col];
-        height_map[col] = abs_end_fill_row;
-        perfect_num_cells_filled += abs_end_fill_row;
+    if(max_row_x_affected >= static_cast<int>(c_rows)){
+        // NOTE: If we're here, this state is never touched again.
+        // Because its game over.
+        return false;
+    }
+
+    dispatch_on_width(ch_map.width, [&](auto width){
+        for(int contour_x = 0; contour_x < width; ++contour_x){
+            const int col = p.get_column() + contour_x;
+            const int abs_end_fill_row = left_bottom_row + ch_map.contour[contour_x] + ch_map.height[contour_x];
 
-        for(int row = abs_start_fill_row; row < abs_end_fill_row; ++row){
-            at(row, col) = true;
+            perfect_num_cells_filled += abs_end_fill_row - height_map[col];
+            height_map[col] = abs_end_fill_row;
         }
+    });
+
+    for(int row = min_row_x_affected; row <= max_row_x_affected; ++row){
+        const Row_t block_row = static_cast<Row_t>(ch_map.row_masks[row - mask_row_offset] << p.get_column());
+        board[row] |= block_row;
+        zobrist_hash ^= hash_cells(row, block_row);
     }
 
-    static const int c_cells_per_block = 4;
     num_cells_filled += c_cells_per_block;
 
     // Check for cleared rows
-    int num_rows_cleared_just_now = 0;
-    for(int row = max_row_x_affected; row >= min_row_x_affected; --row){
-        if(is_row_full(row)){
-            ++num_rows_cleared_just_now;
-            clear_row(row);
-        }
-    }
+    cleared_rows = clear_full_rows(min_row_x_affected, max_row_x_affected);
+    const int num_rows_cleared_just_now = __builtin_popcount(cleared_rows);
 
     // must be called before is_promising.
-    update_secondary_cache(num_rows_cleared_just_now);
+    update_secondary_cache();
 
-    if(!is_promising()){
+    if(!is_promising<Policy>()){
         return false;
     }
 
     update_lifetime_cache(num_rows_cleared_just_now);
+    if(just_swapped){
+        zobrist_hash ^= c_zobrist_keys.just_swapped;
+    }
     just_swapped = false;
     return true;
 }
 
+template <class Policy>
+optional<Board::Utility> Board::get_best_utility_after_placing(const Block& b, long& num_tried){
+
+    optional<Utility> best;
+    Undo_record undo_record;
+    for(int rot_x = 0; rot_x < b.num_rotations; ++rot_x){
+        for(uint16_t cols_left = scan_rotation<Policy>(b, rot_x).promising_cols; cols_left;
+                cols_left &= cols_left - 1){
+            ++num_tried;
+            if(place_block<Policy>(b, {rot_x, __builtin_ctz(cols_left), false}, undo_record)){
+                const Utility_key key = get_utility_key<Policy>();
+                if(!best || key > best->key){
+                    // Fields are only needed for the best, so are built again rather than for every placement.
+                    best = get_utility<Policy>();
+                }
+            }
+            undo(undo_record);
+        }
+    }
+    return best;
+}
+
+// The least every field can be.
+static constexpr Board::Utility_fields c_topped_out_fields = {
+    false,
+    static_cast<int>(Board::c_size),
+    false,
+    false,
+    (1 << c_utility_count_bits) - 1,
+    true,
+    0,
+    false,
+    0,
+    static_cast<int>(Board::c_cols * Board::c_rows * Board::c_rows),
+    static_cast<int>(Board::c_cols),
+    static_cast<int>(Board::c_size)
+};
+
+Board::Utility_expectation::Utility_expectation(const Board_settings& settings)
+    : by_learned_evaluator{settings.learned_evaluator != nullptr} {
+}
+
+void Board::Utility_expectation::add(const optional<Utility>& outcome){
+
+    ++num_outcomes;
+    if(outcome){
+        primary_sum += outcome->key.primary;
+        ema_sum += outcome->max_height_exp_moving_average;
+        ++num_survived;
+    }
+
+    const Utility_fields& fields = outcome ? outcome->fields : c_topped_out_fields;
+    const array<long, tuple_size<decltype(field_sums)>::value> values{
+        fields.good_trench_status,
+        fields.num_holes,
+        fields.in_tetris_mode,
+        fields.at_least_one_side_clear,
+        fields.num_non_tetrises,
+        fields.receives_height_punishment,
+        fields.num_tetrises,
+        fields.is_tetrisable,
+        fields.second_lowest_height,
+        fields.sum_of_squared_heights,
+        fields.num_trenches,
+        fields.num_cells_filled
+    };
+    for(size_t field_x = 0; field_x < field_sums.size(); ++field_x){
+        field_sums[field_x] += values[field_x];
+    }
+}
+
+Board::Utility_expectation& Board::Utility_expectation::operator+=(const Utility_expectation& other){
+    assert(by_learned_evaluator == other.by_learned_evaluator);
+    for(size_t field_x = 0; field_x < field_sums.size(); ++field_x){
+        field_sums[field_x] += other.field_sums[field_x];
+    }
+    primary_sum += other.primary_sum;
+    ema_sum += other.ema_sum;
+    num_outcomes += other.num_outcomes;
+    num_survived += other.num_survived;
+    return *this;
+}
+
+Utility_key Board::Utility_expectation::get_key() const {
+
+    assert(num_outcomes > 0);
+
+    uint64_t secondary = 0;
+    if(num_survived){
+        const double ema = ema_sum / num_survived;
+        uint64_t ema_bits;
+        memcpy(&ema_bits, &ema, sizeof(ema_bits));
+        secondary = ~ema_bits;
+    }
+
+    if(by_learned_evaluator){
+        return {static_cast<uint64_t>(primary_sum / num_outcomes), secondary};
+    }
+
+    // Rounded to the nearest, halves up.
+    const auto mean = [this](size_t field_x){
+        return static_cast<int>((2 * field_sums[field_x] + num_outcomes) / (2 * num_outcomes));
+    };
+    Utility_fields expected;
+    expected.good_trench_status = mean(0);
+    expected.num_holes = mean(1);
+    expected.in_tetris_mode = mean(2);
+    expected.at_least_one_side_clear = mean(3);
+    expected.num_non_tetrises = mean(4);
+    expected.receives_height_punishment = mean(5);
+    expected.num_tetrises = mean(6);
+    expected.is_tetrisable = mean(7);
+    expected.second_lowest_height = mean(8);
+    expected.sum_of_squared_heights = mean(9);
+    expected.num_trenches = mean(10);
+    expected.num_cells_filled = mean(11);
+    return {pack_utility_fields(expected), secondary};
+}
+
+const Block* Board::swap_block(const Block& b, Undo_record& undo_record){
+    save_for_undo(undo_record);
+    undo_record.block = nullptr;
+    return swap_block(b);
+}
+
+void Board::undo(const Undo_record& undo_record){
+
+    if(undo_record.block){
+        const CH_maps& ch_map = undo_record.block->maps[undo_record.rotation];
+        const int mask_row_offset = undo_record.left_bottom_row - CH_maps::c_row_bias;
+        const int min_row_x_affected = mask_row_offset + ch_map.lowest_mask_row;
+        const int max_row_x_affected = mask_row_offset + ch_map.highest_mask_row;
+
+        // Otherwise place_block() gave up before writing anything.
+        if(max_row_x_affected < static_cast<int>(c_rows)){
+            const uint32_t cleared_rows = undo_record.cleared_rows;
+            if(cleared_rows){
+                // Put the full rows back. Top down, so each row is read before anything is written over it.
+                for(int row_x = c_rows - 1; row_x >= __builtin_ctz(cleared_rows); --row_x){
+                    const int num_cleared_at_or_below = __builtin_popcount(cleared_rows & ((2u << row_x) - 1));
+                    board[row_x] = ((cleared_rows >> row_x) & 1) ? c_full_row : board[row_x - num_cleared_at_or_below];
+                }
+            }
+            // The block only wrote to empty cells.
+            for(int row = min_row_x_affected; row <= max_row_x_affected; ++row){
+                board[row] &= static_cast<Row_t>(~(ch_map.row_masks[row - mask_row_offset] << undo_record.column));
+            }
+        }
+    }
+
+    current_hold = undo_record.current_hold;
+    just_swapped = undo_record.just_swapped;
+    zobrist_hash = undo_record.zobrist_hash;
+    height_map = undo_record.height_map;
+    num_cells_filled = undo_record.num_cells_filled;
+    perfect_num_cells_filled = undo_record.perfect_num_cells_filled;
+    num_trenches = undo_record.num_trenches;
+    at_least_one_side_clear = undo_record.at_least_one_side_clear;
+    lowest_height = undo_record.lowest_height;
+    second_lowest_height = undo_record.second_lowest_height;
+    highest_height = undo_record.highest_height;
+    sum_of_squared_heights = undo_record.sum_of_squared_heights;
+    is_tetrisable = undo_record.is_tetrisable;
+    lifetime_stats = undo_record.lifetime_stats;
+    ancestor_with_smallest_max_height = undo_record.ancestor_with_smallest_max_height;
+}
+
+void Board::save_for_undo(Undo_record& undo_record) const {
+    undo_record.current_hold = current_hold;
+    undo_record.just_swapped = just_swapped;
+    undo_record.zobrist_hash = zobrist_hash;
+    undo_record.height_map = height_map;
+    undo_record.num_cells_filled = num_cells_filled;
+    undo_record.perfect_num_cells_filled = perfect_num_cells_filled;
+    undo_record.num_trenches = num_trenches;
+    undo_record.at_least_one_side_clear = at_least_one_side_clear;
+    undo_record.lowest_height = lowest_height;
+    undo_record.second_lowest_height = second_lowest_height;
+    undo_record.highest_height = highest_height;
+    undo_record.sum_of_squared_heights = sum_of_squared_heights;
+    undo_record.is_tetrisable = is_tetrisable;
+    undo_record.lifetime_stats = lifetime_stats;
+    undo_record.ancestor_with_smallest_max_height = ancestor_with_smallest_max_height;
+}
+
 const Block* Board::swap_block(const Block& b){
     const Block* old_hold = current_hold;
     current_hold = &b;
+    zobrist_hash ^= hold_key(old_hold) ^ hold_key(current_hold);
+    if(!just_swapped){
+        zobrist_hash ^= c_zobrist_keys.just_swapped;
+    }
     just_swapped = true;
     return old_hold;
 }
@@ -144,20 +452,246 @@ void Board::set_lifetime_stats(const Board_lifetime_stats& new_lifetime_stats){
     lifetime_stats = new_lifetime_stats;
 }
 
+Board::Packed Board::pack() const {
+
+    // Counts are narrowed. No game gets near overflowing them.
+    assert(lifetime_stats.num_placements_that_cleared_rows <= UINT16_MAX);
+    assert(lifetime_stats.num_all_clears <= UINT16_MAX);
+
+    Packed packed{};
+    for(size_t row_x = 0; row_x < c_rows; ++row_x){
+        const int shift = c_cols * (row_x % c_rows_per_packed_word);
+        packed.grid[row_x / c_rows_per_packed_word] |= static_cast<uint64_t>(board[row_x]) << shift;
+    }
+
+    packed.max_height_exp_moving_average = lifetime_stats.max_height_exp_moving_average;
+    packed.num_blocks_placed = lifetime_stats.num_blocks_placed;
+    packed.num_placements_that_cleared_rows = lifetime_stats.num_placements_that_cleared_rows;
+    packed.num_tetrises = lifetime_stats.num_tetrises;
+    packed.num_non_tetrises = lifetime_stats.num_non_tetrises;
+    packed.num_all_clears = lifetime_stats.num_all_clears;
+
+    const Ancestor_data& ancestor = ancestor_with_smallest_max_height;
+    packed.ancestor_highest_height = ancestor.highest_height;
+    packed.ancestor_second_lowest_height = ancestor.second_lowest_height;
+    packed.ancestor_good_trench_status = ancestor.good_trench_status;
+
+    packed.hold = current_hold ? current_hold->index + 1 : 0;
+    packed.just_swapped = just_swapped;
+    return packed;
+}
+
+template <class Policy>
 bool Board::has_greater_utility_than(const Board& other) const {
 
-    ++gs_num_comparisons;
+    const bool greater = get_utility_key<Policy>() > other.get_utility_key<Policy>();
+#ifdef DEBUG
+    assert(settings->learned_evaluator || greater == has_greater_utility_field_by_field<Policy>(other));
+#endif
+    return greater;
+}
+
+Utility_key Board::get_utility_key() const {
+    return dispatch_on_policy(settings->policy, [this](auto policy){
+        return get_utility_key<decltype(policy)>();
+    });
+}
+
+template <class Policy>
+Utility_key Board::get_utility_key() const {
+
+    uint64_t ema_bits;
+    memcpy(&ema_bits, &lifetime_stats.max_height_exp_moving_average, sizeof(ema_bits));
+    assert(lifetime_stats.max_height_exp_moving_average >= 0);
+
+    if(settings->learned_evaluator){
+        // Sign bit flipped so unsigned order is the score's order.
+        const int64_t score = settings->learned_evaluator->evaluate(get_features());
+        return {static_cast<uint64_t>(score) ^ (uint64_t{1} << 63), ~ema_bits};
+    }
+    return {pack_utility_fields(get_utility_fields<Policy>()), ~ema_bits};
+}
+
+Board::Utility Board::get_utility() const {
+    return dispatch_on_policy(settings->policy, [this](auto policy){
+        return get_utility<decltype(policy)>();
+    });
+}
+
+template <class Policy>
+Board::Utility Board::get_utility() const {
+    return {
+        get_utility_key<Policy>(),
+        settings->learned_evaluator ? Utility_fields{} : get_utility_fields<Policy>(),
+        lifetime_stats.max_height_exp_moving_average
+    };
+}
+
+template <class Policy>
+Board::Utility_fields Board::get_utility_fields() const {
+
+    Utility_fields fields;
+    fields.good_trench_status = has_good_trench_status();
+    fields.num_holes = get_num_holes();
+    fields.in_tetris_mode = highest_height <= Policy::c_max_tetris_mode_height;
+    fields.at_least_one_side_clear = at_least_one_side_clear;
+    fields.num_non_tetrises = lifetime_stats.num_non_tetrises;
+    fields.receives_height_punishment = highest_height - second_lowest_height >= Policy::c_height_diff_punishment_thresh;
+    fields.num_tetrises = lifetime_stats.num_tetrises;
+    fields.is_tetrisable = is_tetrisable;
+    fields.second_lowest_height = second_lowest_height;
+    fields.sum_of_squared_heights = sum_of_squared_heights;
+    fields.num_trenches = num_trenches;
+    fields.num_cells_filled = num_cells_filled;
+    return fields;
+}
+
+// Each field is bounded by the best value it could possibly reach. Packing is monotonic in every field,
+// so the result bounds every reachable key, whichever mode it ends up in.
+template <class Policy>
+Utility_key Board::get_utility_upper_bound(int num_placements, int num_tetris_pieces) const {
+
+    if(settings->learned_evaluator){
+        return {~uint64_t{0}, ~uint64_t{0}};
+    }
+
+    const int max_rows_cleared = get_max_rows_cleared(num_placements);
+
+    Utility_fields fields;
+    fields.good_trench_status = true;
+    fields.num_holes = get_min_holes_after_clearing(max_rows_cleared);
+    // Only clearing rows lowers the highest column.
+    fields.in_tetris_mode = highest_height - max_rows_cleared <= Policy::c_max_tetris_mode_height;
+    fields.at_least_one_side_clear = true;
+    // Never decreases.
+    fields.num_non_tetrises = lifetime_stats.num_non_tetrises;
+    fields.receives_height_punishment = false;
+    fields.num_tetrises = lifetime_stats.num_tetrises + min(num_placements, num_tetris_pieces);
+    fields.is_tetrisable = true;
+    fields.second_lowest_height = c_rows;
+    fields.sum_of_squared_heights = 0;
+    fields.num_trenches = 0;
+    fields.num_cells_filled = 0;
+
+    return {pack_utility_fields(fields), ~uint64_t{0}};
+}
+
+// Packs the field by field comparison into one word, most significant field first.
+// Fields are biased so that greater is always better. Past the tetris mode bit, both boards being compared
+// are in the same mode, so the remaining layout depends on the mode.
+uint64_t Board::pack_utility_fields(const Utility_fields& fields){
+
+    constexpr int c_holes_bits = 8;
+    constexpr int c_height_bits = 5;
+    constexpr int c_trenches_bits = 4;
+    constexpr int c_cells_bits = 8;
+    constexpr int c_sum_of_squares_bits = 12;
+    static_assert(c_size < (1 << c_holes_bits) && c_size < (1 << c_cells_bits));
+    static_assert(c_rows < (1 << c_height_bits) && c_cols < (1 << c_trenches_bits));
+    static_assert(c_cols * c_rows * c_rows < (1 << c_sum_of_squares_bits));
+
+    uint64_t primary = 0;
+    int num_primary_bits = 0;
+    // Append value below everything appended so far.
+    auto append = [&primary, &num_primary_bits](uint64_t value, int num_bits){
+        assert(value < (uint64_t{1} << num_bits));
+        primary = (primary << num_bits) | value;
+        num_primary_bits += num_bits;
+    };
+    // Fewer is better.
+    auto append_inverted = [&append](uint64_t value, int num_bits){
+        append((uint64_t{1} << num_bits) - 1 - value, num_bits);
+    };
+    // Lifetime counts could in principle outgrow their field. Past that they all tie.
+    auto saturate = [](int count){
+        return static_cast<uint64_t>(min(count, (1 << c_utility_count_bits) - 1));
+    };
+
+    append(fields.good_trench_status, 1);
+    append_inverted(fields.num_holes, c_holes_bits);
+    append(fields.in_tetris_mode, 1);
+
+    if(fields.in_tetris_mode){
+        append(fields.at_least_one_side_clear, 1);
+        append_inverted(saturate(fields.num_non_tetrises), c_utility_count_bits);
+        append(!fields.receives_height_punishment, 1);
+        append(saturate(fields.num_tetrises), c_utility_count_bits);
+        append(fields.is_tetrisable, 1);
+        append(fields.second_lowest_height, c_height_bits);
+        append_inverted(fields.sum_of_squared_heights, c_sum_of_squares_bits);
+    }
+    else{
+        append(!fields.receives_height_punishment, 1);
+        append_inverted(fields.num_trenches, c_trenches_bits);
+        append_inverted(fields.num_cells_filled, c_cells_bits);
+        append_inverted(fields.sum_of_squared_heights, c_sum_of_squares_bits);
+    }
+    // Line the fields shared by both modes up at the top, whatever the mode.
+    assert(num_primary_bits <= 64);
+    return primary << (64 - num_primary_bits);
+}
+
+// Rows can only be cleared once some row can be filled without clearing anything first.
+// That needs a row whose empty cells are all open to the sky, and few enough of them for the pieces left.
+int Board::get_max_rows_cleared(int num_placements) const {
+
+    const int num_cells_placeable = num_placements * c_cells_per_block;
+
+    bool some_row_fillable = false;
+    // One past the highest height is an empty row, fillable with enough pieces.
+    for(int row_x = 0; row_x <= highest_height && row_x < static_cast<int>(c_rows); ++row_x){
+        Row_t open_cols = 0;
+        for(size_t col_x = 0; col_x < c_cols; ++col_x){
+            open_cols |= static_cast<Row_t>((height_map[col_x] <= row_x) << col_x);
+        }
+        const Row_t empty_cols = ~board[row_x] & c_full_row;
+        if(!(empty_cols & ~open_cols) && __builtin_popcount(empty_cols) <= num_cells_placeable){
+            some_row_fillable = true;
+            break;
+        }
+    }
+    if(!some_row_fillable){
+        return 0;
+    }
+    // Every cleared row was full.
+    return min(num_placements * c_max_rows_cleared_per_placement,
+        (num_cells_filled + num_cells_placeable) / static_cast<int>(c_cols));
+}
+
+// A column's holes stay until every filled cell above its highest hole is cleared away.
+int Board::get_min_holes_after_clearing(int num_rows_cleared) const {
+
+    const int num_holes = get_num_holes();
+    if(num_rows_cleared == 0 || num_holes == 0){
+        return num_holes;
+    }
+
+    int min_holes = 0;
+    for(size_t col_x = 0; col_x < c_cols; ++col_x){
+        int cover = 0;
+        int row_x = height_map[col_x] - 1;
+        for(; row_x >= 0 && at(row_x, col_x); --row_x){
+            ++cover;
+        }
+        if(cover <= num_rows_cleared){
+            continue;
+        }
+        for(; row_x >= 0; --row_x){
+            min_holes += !at(row_x, col_x);
+        }
+    }
+    return min_holes;
+}
+
+template <class Policy>
+bool Board::has_greater_utility_field_by_field(const Board& other) const {
 
     // if(lifetime_stats.num_all_clears != other.lifetime_stats.num_all_clears){
     //     return lifetime_stats.num_all_clears > other.lifetime_stats.num_all_clears;
     // }
 
-    // You are in tetris mode if you are here or less in height.
-    static const int c_max_tetris_mode_height = 6;
-    static const int c_height_diff_punishment_thresh = 3;
-
-    const bool this_in_tetris_mode = highest_height <= c_max_tetris_mode_height;
-    const bool other_in_tetris_mode = other.highest_height <= c_max_tetris_mode_height;
+    const bool this_in_tetris_mode = highest_height <= Policy::c_max_tetris_mode_height;
+    const bool other_in_tetris_mode = other.highest_height <= Policy::c_max_tetris_mode_height;
 
     // === Fundamental Priorities ===
     if(has_good_trench_status() != other.has_good_trench_status()){
@@ -185,8 +719,8 @@ bool Board::has_greater_utility_than(const Board& other) const {
     }
 
     // Keep relatively even except for the one trench.
-    const bool this_receives_height_punishment = highest_height - second_lowest_height >= c_height_diff_punishment_thresh;
-    const bool other_receives_height_punishment = other.highest_height - other.second_lowest_height >= c_height_diff_punishment_thresh;
+    const bool this_receives_height_punishment = highest_height - second_lowest_height >= Policy::c_height_diff_punishment_thresh;
+    const bool other_receives_height_punishment = other.highest_height - other.second_lowest_height >= Policy::c_height_diff_punishment_thresh;
     if(this_receives_height_punishment != other_receives_height_punishment){
         return !this_receives_height_punishment;
     }
@@ -239,6 +773,65 @@ int Board::get_num_holes() const {
     return perfect_num_cells_filled - num_cells_filled;
 }
 
+Board::Features_t Board::get_features() const {
+
+    Features_t features = {0};
+
+    // A column's holes are the empty cells under its top. Counts filled cells a column per byte,
+    // eight columns at a time. No column holds more than c_rows, so bytes never overflow.
+    static_assert(c_rows < 256 && c_cols <= 16, "Filled cell counts fit two words of byte lanes.");
+    static constexpr array<uint64_t, 256> c_bits_to_bytes = []{
+        array<uint64_t, 256> bytes = {0};
+        for(size_t bits = 0; bits < bytes.size(); ++bits){
+            for(size_t bit_x = 0; bit_x < 8; ++bit_x){
+                bytes[bits] |= static_cast<uint64_t>((bits >> bit_x) & 1) << (8 * bit_x);
+            }
+        }
+        return bytes;
+    }();
+    uint64_t num_filled_low = 0;
+    uint64_t num_filled_high = 0;
+    for(int row_x = 0; row_x < highest_height; ++row_x){
+        num_filled_low += c_bits_to_bytes[board[row_x] & 0xFF];
+        num_filled_high += c_bits_to_bytes[board[row_x] >> 8];
+    }
+    const auto num_filled = [num_filled_low, num_filled_high](size_t col_x){
+        return static_cast<int>(((col_x < 8 ? num_filled_low : num_filled_high) >> (8 * (col_x % 8))) & 0xFF);
+    };
+
+    int deepest_well = 0;
+    for(size_t col_x = 0; col_x < c_cols; ++col_x){
+        features[col_x] = height_map[col_x];
+        features[c_cols + col_x] = static_cast<int16_t>(height_map[col_x] - num_filled(col_x));
+        // Walls are as tall as the board.
+        const int left = col_x == 0 ? c_rows : height_map[col_x - 1];
+        const int right = col_x == c_cols - 1 ? c_rows : height_map[col_x + 1];
+        deepest_well = max(deepest_well, min(left, right) - height_map[col_x]);
+    }
+
+    const auto saturate = [](int count){
+        return static_cast<int16_t>(min(count, static_cast<int>(numeric_limits<int16_t>::max())));
+    };
+    features[20] = static_cast<int16_t>(deepest_well);
+    features[21] = saturate(lifetime_stats.num_tetrises);
+    features[22] = saturate(lifetime_stats.num_non_tetrises);
+    // Never negative, so adding a half rounds.
+    features[23] = static_cast<int16_t>(lifetime_stats.max_height_exp_moving_average * 16 + 0.5);
+    features[current_hold ? 24 + current_hold->index : 31] = 1;
+    features[32] = 1;
+    return features;
+}
+
+const Board_settings Board::c_default_settings;
+
+void Board::use_settings(const Board_settings& _settings){
+    settings = &_settings;
+}
+
+const Board_settings& Board::get_settings() const {
+    return *settings;
+}
+
 bool Board::can_swap_block(const Block& b) const {
     if(&b == current_hold){
         return false;
@@ -250,6 +843,18 @@ bool Board::is_holding_some_block() const {
     return current_hold;
 }
 
+bool Board::is_holding(const Block& b) const {
+    return current_hold == &b;
+}
+
+const Block* Board::get_held_block() const {
+    return current_hold;
+}
+
+bool Board::looks_the_same_as(const Board& other) const {
+    return board == other.board && current_hold == other.current_hold && just_swapped == other.just_swapped;
+}
+
 int Board::get_num_blocks_placed() const {
     return lifetime_stats.num_blocks_placed;
 }
@@ -270,33 +875,73 @@ Board_lifetime_stats Board::get_lifetime_stats() const {
     return lifetime_stats;
 }
 
-void Board::clear_row(int deleted_row) {
+uint64_t Board::get_search_key() const {
 
-    Grid_t board_shifted_down = board << c_cols;
+    uint64_t ema_bits;
+    static_assert(sizeof(ema_bits) == sizeof(lifetime_stats.max_height_exp_moving_average));
+    memcpy(&ema_bits, &lifetime_stats.max_height_exp_moving_average, sizeof(ema_bits));
 
-    Grid_t below_del_row_mask;
-    below_del_row_mask.set();
-    below_del_row_mask <<= (c_cols * (c_rows - deleted_row));
+    const Ancestor_data& ancestor = ancestor_with_smallest_max_height;
 
-    Grid_t above_including_del_row_mask{~below_del_row_mask};
+    uint64_t key = zobrist_hash;
+    key = hash_combine(key, lifetime_stats.num_blocks_placed);
+    key = hash_combine(key, lifetime_stats.num_tetrises);
+    key = hash_combine(key, lifetime_stats.num_non_tetrises);
+    key = hash_combine(key, ema_bits);
+    key = hash_combine(key, ancestor.highest_height);
+    key = hash_combine(key, ancestor.second_lowest_height);
+    key = hash_combine(key, ancestor.good_trench_status);
+    return key;
+}
 
-    for(int col_x = 0; col_x < c_cols; ++col_x){
-        int reduction = get_height_map_reduction(deleted_row, col_x);
-        height_map[col_x] -= reduction;
-        perfect_num_cells_filled -= reduction;
-    }
+uint32_t Board::clear_full_rows(int lowest_row, int highest_row) {
 
-    board =
-        (board & below_del_row_mask) |
-        (board_shifted_down & above_including_del_row_mask);
+    int first_full_row = -1;
+    for(int row_x = lowest_row; row_x <= highest_row; ++row_x){
+        if(is_row_full(row_x)){
+            first_full_row = row_x;
+            break;
+        }
+    }
+    if(first_full_row == -1){
+        return 0;
+    }
 
-    num_cells_filled -= c_cols;
-}
+    // Compact: slide every non-full row down over the full ones.
+    // Every full row is at or below highest_row, and nothing is above highest_height.
+    const int top_row = max(highest_row, highest_height - 1);
+    uint32_t cleared_rows = 0;
+    int write_row = first_full_row;
+    for(int read_row = first_full_row; read_row <= top_row; ++read_row){
+        zobrist_hash ^= hash_cells(read_row, board[read_row]);
+        if(!is_row_full(read_row)){
+            board[write_row++] = board[read_row];
+        }
+        else{
+            cleared_rows |= 1u << read_row;
+        }
+    }
+    const int num_cleared = top_row + 1 - write_row;
+    for(int row_x = first_full_row; row_x < write_row; ++row_x){
+        zobrist_hash ^= hash_cells(row_x, board[row_x]);
+    }
+    for(; write_row <= top_row; ++write_row){
+        board[write_row] = 0;
+    }
 
-Board::Grid_t::reference Board::at(size_t row, size_t col){
+    // Every column had a cell in every cleared row, so each column is at least num_cleared shorter.
+    // If its surface cell was cleared, holes beneath it may now be exposed.
+    for(int col_x = 0; col_x < static_cast<int>(c_cols); ++col_x){
+        int new_height = height_map[col_x] - num_cleared;
+        while(new_height > 0 && !at(new_height - 1, col_x)){
+            --new_height;
+        }
+        perfect_num_cells_filled -= height_map[col_x] - new_height;
+        height_map[col_x] = new_height;
+    }
 
-    size_t idx = c_size - 1 - ((row * c_cols) + col);
-    return board[idx];
+    num_cells_filled -= num_cleared * c_cols;
+    return cleared_rows;
 }
 
 void Board::load_ancestral_data_with_current_data() {
@@ -308,50 +953,41 @@ void Board::load_ancestral_data_with_current_data() {
 
 
 bool Board::at(size_t row, size_t col) const {
-    size_t idx = c_size - 1 - ((row * c_cols) + col);
-    return board[idx];
+    return (board[row] >> col) & 1u;
 }
 
 bool Board::is_row_full(int row) const {
-
-    for(int col = 0; col < c_cols; ++col){
-        if(!at(row, col)){
-            return false;
-        }
-    }
-    return true;
+    return board[row] == c_full_row;
 }
 
 // Compute height based on "board" only.
 int Board::compute_height(size_t col_x) const {
-    int height = 0;
-    for(size_t row_x = 0; row_x < c_rows; ++row_x){
+    for(int row_x = static_cast<int>(c_rows) - 1; row_x >= 0; --row_x){
         if(at(row_x, col_x)){
-            height = row_x + 1;
+            return row_x + 1;
         }
     }
-    return height;
+    return 0;
 }
 
+// NOTE: scan_rotation() mirrors this for placements that clear no rows. Keep them in sync.
+template <class Policy>
 bool Board::is_promising() const {
 
-    static constexpr int max_acceptable_holes_above_anc = 0;
-    static constexpr int max_acceptable_height_increase = 3;
-
     const Ancestor_data& ancestor = ancestor_with_smallest_max_height;
 
     bool added_needless_trench = ancestor.good_trench_status && !has_good_trench_status();
 
-    if(highest_height - ancestor.highest_height > max_acceptable_height_increase){
+    if(settings->pruning_rules.height_increase
+            && highest_height - ancestor.highest_height > Policy::c_max_acceptable_height_increase){
         return false;
     }
-    if(added_needless_trench){
+    if(added_needless_trench || !settings->pruning_rules.holes_above_ancestor){
         return true;
     }
 
-    int hole_leeway = (ancestor.highest_height == ancestor.second_lowest_height) ? 1 : 0;
-    int holes_above_anc_max = num_holes_above_height(ancestor.highest_height + hole_leeway);
-    if(holes_above_anc_max > max_acceptable_holes_above_anc){
+    int holes_above_anc_max = num_holes_above_height(get_hole_floor());
+    if(holes_above_anc_max > Policy::c_max_acceptable_holes_above_anc){
         return false;
     }
 
@@ -359,97 +995,286 @@ bool Board::is_promising() const {
 
 }
 
+int Board::get_hole_floor() const {
+    const Ancestor_data& ancestor = ancestor_with_smallest_max_height;
+    int hole_leeway = (ancestor.highest_height == ancestor.second_lowest_height) ? 1 : 0;
+    return ancestor.highest_height + hole_leeway;
+}
+
 bool Board::has_good_trench_status() const {
     return num_trenches <= 1;
 }
 
 int Board::num_holes_above_height(int height) const {
 
+    // A cell is a hole iff it is empty and something in its column is above it.
+    // Walk down from the top, tracking which columns are covered.
     int found = 0;
-    for(int col_x = 0; col_x < c_cols; ++col_x){
-        // Would still be correct if it was height_map[col_x] - 1,
-        for(int row_x = height; row_x <= height_map[col_x] - 2; ++row_x){
-            if(!at(row_x, col_x)){
-                ++found;
-            }
-        }
+    Row_t covered = 0;
+    for(int row_x = highest_height - 1; row_x >= height; --row_x){
+        found += __builtin_popcount(covered & ~board[row_x]);
+        covered |= board[row_x];
     }
     return found;
 }
 
+uint64_t Board::hash_cells(int row, Row_t cells){
+    uint64_t hash = 0;
+    for(; cells; cells &= cells - 1){
+        hash ^= c_zobrist_keys.cells[row * c_cols + __builtin_ctz(cells)];
+    }
+    return hash;
+}
+
+uint64_t Board::compute_zobrist_hash() const {
+    uint64_t hash = hold_key(current_hold);
+    if(just_swapped){
+        hash ^= c_zobrist_keys.just_swapped;
+    }
+    for(int row_x = 0; row_x < static_cast<int>(c_rows); ++row_x){
+        hash ^= hash_cells(row_x, board[row_x]);
+    }
+    return hash;
+}
+
 int Board::get_row_after_drop(const Block& b, Placement p) const {
 
-    const auto& contour = b.maps[p.get_rotation()].contour;
-    int num_cols_to_inspect = contour.size();
+    const CH_maps& ch_map = b.maps[p.get_rotation()];
+    assert(ch_map.contour.front() == 0);
+
+    return dispatch_on_width(ch_map.width, [&](auto width){
+        int max_row = height_map[p.get_column()];
+        for(int col_x = 1; col_x < width; ++col_x){
+            int board_col = p.get_column() + col_x;
+            int row = height_map[board_col] - ch_map.contour[col_x];
+            max_row = max(max_row, row);
+        }
+        return max_row;
+    });
+}
 
-    int max_row = height_map[p.get_column()];
-    assert(contour.front() == 0);
+template <class Policy>
+Board::Rotation_scan Board::scan_rotation(const Block& b, int rot_x) const {
+    return dispatch_on_width(b.maps[rot_x].width, [&](auto width){
+        return scan_rotation<Policy, width>(b.maps[rot_x]);
+    });
+}
 
-    for(int col_x = 1; col_x < num_cols_to_inspect; ++col_x){
-        int board_col = p.get_column() + col_x;
-        int row = height_map[board_col] - contour[col_x];
-        max_row = max(max_row, row);
-    }
-    return max_row;
+Board::Rotation_scan Board::scan_rotation(const Block& b, int rot_x) const {
+    return dispatch_on_policy(settings->policy, [&](auto policy){
+        return scan_rotation<decltype(policy)>(b, rot_x);
+    });
 }
 
-// Given a row is being deleted, how many to subtract from the height map
-// of query col. (Maybe holes will become exposed.)
-int Board::get_height_map_reduction(int deleted_row, int query_col) const {
+template <class Policy, int Width>
+Board::Rotation_scan Board::scan_rotation(const CH_maps& ch_map) const {
+
+    const int max_valid_col = ch_map.max_valid_col;
+    assert(ch_map.contour.front() == 0);
+
+    Rotation_scan scan;
+
+    // === Landing rows for every column at once ===
+    // landing_row[col] = max over the contour of height_map[col + contour_x] - contour[contour_x].
+    // Offsetting by the row bias keeps everything unsigned.
+    static constexpr int c_contour_bias = CH_maps::c_row_bias;
+#ifdef __SSE2__
+    alignas(16) std::array<std::uint8_t, c_padded_cols> biased_landing;
+    const __m128i heights = _mm_load_si128(reinterpret_cast<const __m128i*>(height_map.data()));
+    __m128i landing = _mm_add_epi8(heights, _mm_set1_epi8(c_contour_bias));
+    // Byte shifts need immediates.
+    if constexpr(Width > 1){
+        landing = _mm_max_epu8(landing, _mm_add_epi8(_mm_srli_si128(heights, 1),
+            _mm_set1_epi8(static_cast<char>(c_contour_bias - ch_map.contour[1]))));
+    }
+    if constexpr(Width > 2){
+        landing = _mm_max_epu8(landing, _mm_add_epi8(_mm_srli_si128(heights, 2),
+            _mm_set1_epi8(static_cast<char>(c_contour_bias - ch_map.contour[2]))));
+    }
+    if constexpr(Width > 3){
+        landing = _mm_max_epu8(landing, _mm_add_epi8(_mm_srli_si128(heights, 3),
+            _mm_set1_epi8(static_cast<char>(c_contour_bias - ch_map.contour[3]))));
+    }
+    _mm_store_si128(reinterpret_cast<__m128i*>(biased_landing.data()), landing);
+    for(int col = 0; col <= max_valid_col; ++col){
+        scan.landing_row[col] = biased_landing[col] - c_contour_bias;
+    }
+#else
+    for(int col = 0; col <= max_valid_col; ++col){
+        int max_row = height_map[col];
+        for(int contour_x = 1; contour_x < Width; ++contour_x){
+            max_row = max(max_row, height_map[col + contour_x] - ch_map.contour[contour_x]);
+        }
+        scan.landing_row[col] = max_row;
+    }
+#endif
 
-    int reductions = 1;
-    // The deleted row IS NOT THE SURFACE at this column.
-    bool is_surface = deleted_row == height_map[query_col] - 1;
-    if(is_surface){
-        for(int row_x = deleted_row - 1;
-                row_x >= 0 && !at(row_x, query_col); --row_x){
-            ++reductions;
+    // === Score each column ===
+    const Ancestor_data& ancestor = ancestor_with_smallest_max_height;
+    const int hole_floor = get_hole_floor();
+    const int holes_above_floor = num_holes_above_height(hole_floor);
+
+    for(int col = 0; col <= max_valid_col; ++col){
+
+        const int landing_row = scan.landing_row[col];
+        const int mask_row_offset = landing_row - c_contour_bias;
+        const Row_t col_bit = static_cast<Row_t>(1u << col);
+
+        if(mask_row_offset + ch_map.highest_mask_row >= static_cast<int>(c_rows)){
+            // Tops out.
+            continue;
+        }
+
+        int new_holes = 0;
+        for(int contour_x = 0; contour_x < Width; ++contour_x){
+            new_holes += landing_row + ch_map.contour[contour_x] - height_map[col + contour_x];
+        }
+        scan.new_holes[col] = new_holes;
+
+        bool clears_rows = false;
+        for(int mask_row = ch_map.lowest_mask_row; mask_row <= ch_map.highest_mask_row; ++mask_row){
+            const Row_t block_row = static_cast<Row_t>(ch_map.row_masks[mask_row] << col);
+            if((board[mask_row_offset + mask_row] | block_row) == c_full_row){
+                clears_rows = true;
+            }
+        }
+        if(clears_rows){
+            // Line clears can lower every column and reset the ancestor. Let place_block() decide.
+            scan.clearing_cols |= col_bit;
+            scan.promising_cols |= col_bit;
+            continue;
+        }
+
+        alignas(16) Height_map_t new_heights = height_map;
+        int new_holes_above_floor = 0;
+        for(int contour_x = 0; contour_x < Width; ++contour_x){
+            const int board_col = col + contour_x;
+            const int abs_start_fill_row = landing_row + ch_map.contour[contour_x];
+            new_holes_above_floor += max(0, abs_start_fill_row - max<int>(height_map[board_col], hole_floor));
+            new_heights[board_col] = abs_start_fill_row + ch_map.height[contour_x];
+        }
+
+        const Height_stats& stats = scan.stats[col] = compute_height_stats(new_heights);
+
+        // Mirrors is_promising(). With no rows cleared, highest_height cannot drop,
+        // so the ancestor is the same as ours.
+        if(settings->pruning_rules.height_increase
+                && stats.highest_height - ancestor.highest_height > Policy::c_max_acceptable_height_increase){
+            continue;
+        }
+        const bool added_needless_trench = ancestor.good_trench_status && stats.num_trenches > 1;
+        if(added_needless_trench || !settings->pruning_rules.holes_above_ancestor
+                || holes_above_floor + new_holes_above_floor <= Policy::c_max_acceptable_holes_above_anc){
+            scan.promising_cols |= col_bit;
         }
     }
-    return reductions;
+    return scan;
 }
 
-void Board::update_secondary_cache(int num_rows_cleared_just_now) {
+Height_stats Board::compute_height_stats(const Height_map_t& heights) {
 
     static constexpr int impossibly_high_wall = c_rows + 5;
     static constexpr int min_depth_considered_trench = 3;
-
-    num_trenches = 0;
-    at_least_one_side_clear = (height_map[0] == 0) || (height_map[c_cols - 1] == 0);
-    lowest_height = c_rows;
-    second_lowest_height = c_rows;
-    highest_height = 0;
-    sum_of_squared_heights = 0;
-
-    int left_height = impossibly_high_wall;
-    int middle_height = height_map[0];
-    int right_height = height_map[1];
-
-    int some_trench_height = 0;
+    static constexpr int c_real_cols_mask = (1 << c_cols) - 1;
+
+    Height_stats stats;
+
+#ifdef __SSE2__
+    // Padding lanes (c_cols and above) are 0.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i middle = _mm_load_si128(reinterpret_cast<const __m128i*>(heights.data()));
+
+    // Highest: padding is 0, so it never wins.
+    __m128i folded = middle;
+    folded = _mm_max_epu8(folded, _mm_srli_si128(folded, 8));
+    folded = _mm_max_epu8(folded, _mm_srli_si128(folded, 4));
+    folded = _mm_max_epu8(folded, _mm_srli_si128(folded, 2));
+    folded = _mm_max_epu8(folded, _mm_srli_si128(folded, 1));
+    stats.highest_height = _mm_cvtsi128_si32(folded) & 0xFF;
+
+    // Lowest, then second lowest with one copy of the lowest removed. Padding is pushed to 0xFF.
+    const __m128i padding = _mm_set_epi8(-1, -1, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i padded = _mm_or_si128(middle, padding);
+    auto horizontal_min = [](__m128i v){
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 4));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 2));
+        v = _mm_min_epu8(v, _mm_srli_si128(v, 1));
+        return _mm_cvtsi128_si32(v) & 0xFF;
+    };
+    stats.lowest_height = horizontal_min(padded);
+    const int lowest_lanes = _mm_movemask_epi8(
+        _mm_cmpeq_epi8(padded, _mm_set1_epi8(static_cast<char>(stats.lowest_height))));
+    alignas(16) Height_map_t without_one_lowest;
+    _mm_store_si128(reinterpret_cast<__m128i*>(without_one_lowest.data()), padded);
+    without_one_lowest[__builtin_ctz(lowest_lanes)] = 0xFF;
+    stats.second_lowest_height = horizontal_min(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(without_one_lowest.data())));
+
+    // Sum of squares in 16 bit lanes.
+    const __m128i low_half = _mm_unpacklo_epi8(middle, zero);
+    const __m128i high_half = _mm_unpackhi_epi8(middle, zero);
+    __m128i sums = _mm_add_epi32(_mm_madd_epi16(low_half, low_half), _mm_madd_epi16(high_half, high_half));
+    sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 8));
+    sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 4));
+    stats.sum_of_squared_heights = _mm_cvtsi128_si32(sums);
+
+    // Trenches: both neighbors at least min_depth_considered_trench higher. Walls are impossibly high.
+    const __m128i left_wall = _mm_set_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, impossibly_high_wall);
+    const __m128i right_wall = _mm_set_epi8(0, 0, 0, 0, 0, 0, impossibly_high_wall, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i left = _mm_or_si128(_mm_slli_si128(middle, 1), left_wall);
+    const __m128i right = _mm_or_si128(_mm_srli_si128(middle, 1), right_wall);
+    const __m128i shallower_side = _mm_min_epu8(_mm_subs_epu8(left, middle), _mm_subs_epu8(right, middle));
+    const __m128i not_trench = _mm_cmpeq_epi8(
+        _mm_subs_epu8(shallower_side, _mm_set1_epi8(min_depth_considered_trench - 1)), zero);
+    const int trench_lanes = ~_mm_movemask_epi8(not_trench) & c_real_cols_mask;
+    stats.num_trenches = __builtin_popcount(trench_lanes);
+    if(trench_lanes){
+        stats.some_trench_height = heights[__builtin_ctz(trench_lanes)];
+    }
+#else
+    stats.lowest_height = c_rows;
+    stats.second_lowest_height = c_rows;
 
     for(int col_x = 0; col_x < c_cols; ++col_x){
 
-        sum_of_squared_heights += middle_height * middle_height;
-        second_lowest_height = middle_height <= lowest_height ? lowest_height : min(second_lowest_height, middle_height);
-        lowest_height = min(lowest_height, middle_height);
-        highest_height = max(highest_height, middle_height);
+        const int middle_height = heights[col_x];
+        const int left_height = col_x == 0 ? impossibly_high_wall : heights[col_x - 1];
+        const int right_height = col_x == c_cols - 1 ? impossibly_high_wall : heights[col_x + 1];
+
+        stats.sum_of_squared_heights += middle_height * middle_height;
+        stats.second_lowest_height = middle_height <= stats.lowest_height ?
+            stats.lowest_height : min(stats.second_lowest_height, middle_height);
+        stats.lowest_height = min(stats.lowest_height, middle_height);
+        stats.highest_height = max(stats.highest_height, middle_height);
 
         // count and keep track of a trench.
         if(left_height - middle_height >= min_depth_considered_trench
                 && right_height - middle_height >= min_depth_considered_trench){
-            ++num_trenches;
-            some_trench_height = middle_height;
+            ++stats.num_trenches;
+            stats.some_trench_height = middle_height;
         }
-
-        left_height = middle_height;
-        middle_height = right_height;
-        right_height = (col_x == c_cols - 2) ? impossibly_high_wall : height_map[col_x + 2];
     }
+#endif
+
+    return stats;
+}
+
+void Board::update_secondary_cache() {
+
+    const Height_stats stats = compute_height_stats(height_map);
+
+    num_trenches = stats.num_trenches;
+    at_least_one_side_clear = (height_map[0] == 0) || (height_map[c_cols - 1] == 0);
+    lowest_height = stats.lowest_height;
+    second_lowest_height = stats.second_lowest_height;
+    highest_height = stats.highest_height;
+    sum_of_squared_heights = stats.sum_of_squared_heights;
 
     is_tetrisable =
         num_trenches == 1
-        && lowest_height == some_trench_height
-        && second_lowest_height >= some_trench_height + 4;
+        && lowest_height == stats.some_trench_height
+        && second_lowest_height >= stats.some_trench_height + 4;
 
     if(highest_height < ancestor_with_smallest_max_height.highest_height){
         load_ancestral_data_with_current_data();
@@ -476,3 +1301,19 @@ void Board::update_lifetime_cache(int num_rows_cleared_just_now){
         (0.5 * lifetime_stats.max_height_exp_moving_average);
 
 }
+
+// The search's entry points, for every policy.
+#define INSTANTIATE_BOARD_FOR_POLICY(Policy) \
+    template bool Board::place_block<Policy>(const Block& b, Placement p); \
+    template bool Board::place_block<Policy>(const Block& b, Placement p, Undo_record& undo_record); \
+    template optional<Board::Utility> Board::get_best_utility_after_placing<Policy>(const Block& b, long& num_tried); \
+    template Board::Utility_fields Board::get_utility_fields<Policy>() const; \
+    template Board::Utility Board::get_utility<Policy>() const; \
+    template bool Board::has_greater_utility_than<Policy>(const Board& other) const; \
+    template bool Board::has_greater_utility_field_by_field<Policy>(const Board& other) const; \
+    template Utility_key Board::get_utility_key<Policy>() const; \
+    template Utility_key Board::get_utility_upper_bound<Policy>(int num_placements, int num_tetris_pieces) const; \
+    template Board::Rotation_scan Board::scan_rotation<Policy>(const Block& b, int rot_x) const; \
+    template bool Board::is_promising<Policy>() const;
+FOR_EACH_POLICY(INSTANTIATE_BOARD_FOR_POLICY)
+#undef INSTANTIATE_BOARD_FOR_POLICY
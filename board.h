@@ -1,15 +1,19 @@
 #ifndef BOARD_H
 #define BOARD_H
 
-#include <bitset>
+#include <cstdint>
 #include <utility>
 #include <optional>
 #include <array>
 
 #include <iosfwd>
 
+#include "search_policy.h"
+
 struct Block;
-struct Placement;
+struct CH_maps;
+class Placement;
+class Learned_evaluator;
 
 struct Board_lifetime_stats {
     int num_blocks_placed = 0;
@@ -26,6 +30,48 @@ struct Ancestor_data {
     bool good_trench_status = true;
 };
 
+// Everything the secondary cache derives from the height map, computed in one pass.
+struct Height_stats {
+    int num_trenches = 0;
+    int lowest_height = 0;
+    int second_lowest_height = 0;
+    int highest_height = 0;
+    int sum_of_squared_heights = 0;
+    // Height of some trench. Only meaningful when num_trenches == 1.
+    int some_trench_height = 0;
+};
+
+// The rules is_promising() prunes placements by. Their thresholds come from the board's policy.
+// Each can be turned off, to measure what it saves and what it costs. All are on unless turned off.
+struct Pruning_rules {
+    // Raising the highest column too far above the ancestor's.
+    bool height_increase = true;
+    // Leaving holes above the ancestor's highest column.
+    bool holes_above_ancestor = true;
+};
+
+// How a board is scored and pruned. Owned by an Engine, and shared by every board it searches,
+// so two engines can search with different settings at once.
+struct Board_settings {
+    // Members templated on a Policy are compiled once per policy in search_policy.h, for the search.
+    // Their untemplated overloads use this one.
+    Policy_id policy = Policy_id::standard;
+    Pruning_rules pruning_rules;
+    // Scores boards instead of the hand-written utility. Null for the hand-written utility.
+    const Learned_evaluator* learned_evaluator = nullptr;
+};
+
+// A board's utility, compiled into integers. Greater is better.
+struct Utility_key {
+    std::uint64_t primary = 0;
+    // Bitwise not of the max height moving average. Non-negative doubles order like their bits.
+    std::uint64_t secondary = 0;
+
+    bool operator>(const Utility_key& other) const {
+        return primary != other.primary ? primary > other.primary : secondary > other.secondary;
+    }
+};
+
 class Board {
 
 public:
@@ -39,24 +85,213 @@ public:
     static constexpr size_t c_rows = 20;
     static constexpr size_t c_size = c_cols * c_rows;
 
+    // Heights are stored one byte per column, padded out to a full SSE register.
+    static constexpr size_t c_padded_cols = 16;
+    using Height_map_t = std::array<std::uint8_t, c_padded_cols>;
+
+    // Result of dropping one rotation of a block at every legal column at once.
+    // Entries are only meaningful for columns up to the block's max valid placement column.
+    struct Rotation_scan {
+        std::array<int, c_cols> landing_row;
+        // Empty cells left under the block, before any rows are cleared.
+        std::array<int, c_cols> new_holes;
+        // Stats of the resulting height map, assuming no rows are cleared.
+        std::array<Height_stats, c_cols> stats;
+        // Bit col is set iff dropping here fills at least one row.
+        std::uint16_t clearing_cols = 0;
+        // Bit col is set iff place_block() here might be promising.
+        // Unset columns are guaranteed to be rejected by place_block(), so need not be tried.
+        std::uint16_t promising_cols = 0;
+    };
+
+    static constexpr size_t c_rows_per_packed_word = 64 / c_cols;
+    static constexpr size_t c_packed_words = (c_rows + c_rows_per_packed_word - 1) / c_rows_per_packed_word;
+
+    // Just enough to rebuild a board exactly. Every cache is recomputed from it.
+    struct Packed {
+        // Row row_x starts at bit c_cols * (row_x % c_rows_per_packed_word) of word row_x / c_rows_per_packed_word.
+        std::array<std::uint64_t, c_packed_words> grid;
+        double max_height_exp_moving_average;
+        std::uint32_t num_blocks_placed;
+        std::uint16_t num_placements_that_cleared_rows;
+        std::uint16_t num_tetrises;
+        std::uint16_t num_non_tetrises;
+        std::uint16_t num_all_clears;
+        std::uint8_t ancestor_highest_height;
+        std::uint8_t ancestor_second_lowest_height : 7;
+        std::uint8_t ancestor_good_trench_status : 1;
+        // Block index + 1. 0 for no hold.
+        std::uint8_t hold : 7;
+        std::uint8_t just_swapped : 1;
+    };
+
+    // Settings are not packed. The board uses settings, as if by use_settings().
+    Board(const Packed& packed, const Board_settings& settings);
+
+    // What a Learned_evaluator sees of a board. Entries:
+    // [0, 10) column heights. [10, 20) holes in each column. 20 deepest well. 21 tetrises. 22 non tetrises.
+    // 23 max height moving average, in sixteenths. [24, 32) the held block, one hot by index, 31 for none.
+    // 32 always 1. Zero past c_num_features, so dot products run over whole AVX2 registers.
+    // Never negative.
+    static constexpr size_t c_num_features = 33;
+    static constexpr size_t c_padded_features = 48;
+    using Features_t = std::array<std::int16_t, c_padded_features>;
+
+    // This board, and every board copied from it from now on, is scored and pruned by settings.
+    // Until then, boards use the default Board_settings.
+    // Requires: Settings outlives every board that uses it.
+    void use_settings(const Board_settings& settings);
+    const Board_settings& get_settings() const;
+
+    // What place_block() or swap_block() changed, so undo() can put it back.
+    // The grid is not copied. It is rebuilt from the cells the block wrote and the rows that were cleared.
+    struct Undo_record {
+        // Null for a swap, which leaves the grid alone.
+        const Block* block = nullptr;
+        int rotation = 0;
+        int column = 0;
+        int left_bottom_row = 0;
+        // Bit row_x is set iff row row_x was cleared, numbered as before clearing.
+        std::uint32_t cleared_rows = 0;
+
+        // Everything else, as it was. Keep in sync with Board's members.
+        const Block* current_hold;
+        bool just_swapped;
+        std::uint64_t zobrist_hash;
+        Height_map_t height_map;
+        int num_cells_filled;
+        int perfect_num_cells_filled;
+        int num_trenches;
+        bool at_least_one_side_clear;
+        int lowest_height;
+        int second_lowest_height;
+        int highest_height;
+        int sum_of_squared_heights;
+        bool is_tetrisable;
+        Board_lifetime_stats lifetime_stats;
+        Ancestor_data ancestor_with_smallest_max_height;
+    };
+
     friend std::ostream& operator<<(std::ostream& os, const Board& s);
+    // Times the private kernels on their own. See bench_kernels.cpp.
+    friend struct Kernel_bench;
+    // Checks the utility key against the comparator it was compiled from. See test_utility_key.cpp.
+    friend struct Utility_key_test;
+    // Checks expected keys against packed averages. See test_chance_key.cpp.
+    friend struct Chance_key_test;
+
+    // Everything the utility key is built from.
+    // Which are used depends on in_tetris_mode.
+    struct Utility_fields {
+        bool good_trench_status;
+        int num_holes;
+        bool in_tetris_mode;
+        bool at_least_one_side_clear;
+        int num_non_tetrises;
+        bool receives_height_punishment;
+        int num_tetrises;
+        bool is_tetrisable;
+        int second_lowest_height;
+        int sum_of_squared_heights;
+        int num_trenches;
+        int num_cells_filled;
+    };
+
+    // A board's utility key, with what it was built from, so expectations can be taken field by field.
+    // Fields are left empty under a learned evaluator, whose key is a single score.
+    struct Utility {
+        Utility_key key;
+        Utility_fields fields;
+        double max_height_exp_moving_average;
+    };
+
+    // The expectation of each utility field over equally likely outcomes, added one at a time.
+    class Utility_expectation {
+
+    public:
+
+        // Outcomes are scored by settings' evaluator.
+        explicit Utility_expectation(const Board_settings& settings);
+
+        // Empty if the outcome topped out. Topping out is worth the least of every field.
+        void add(const std::optional<Utility>& outcome);
+        Utility_expectation& operator+=(const Utility_expectation& other);
+
+        // Requires: Some outcome was added.
+        // Fields are averaged on their own and packed again, so one field's spread never carries into the one above.
+        // Means are rounded to the nearest unit, so fields whose means are within half a unit may tie.
+        // A learned evaluator's score is one field, so its keys are averaged.
+        // The moving average only breaks ties, so is averaged over the outcomes that did not top out.
+        Utility_key get_key() const;
+
+    private:
+
+        bool by_learned_evaluator;
+        // In the order of Utility_fields.
+        std::array<long, 12> field_sums = {};
+        unsigned __int128 primary_sum = 0;
+        double ema_sum = 0;
+        int num_outcomes = 0;
+        int num_survived = 0;
+    };
 
     // FUNCTIONS
     // Modifying
     // Given a placement decision and block, completely modify the state.
+    // Returns true iff the result is promising under Policy.
+    template <class Policy>
+    bool place_block(const Block& b, Placement p);
     bool place_block(const Block& b, Placement p);
     const Block* swap_block(const Block& b);
+    // As above, recording the change in undo_record.
+    template <class Policy>
+    bool place_block(const Block& b, Placement p, Undo_record& undo_record);
+    bool place_block(const Block& b, Placement p, Undo_record& undo_record);
+    const Block* swap_block(const Block& b, Undo_record& undo_record);
+    // Requires: undo_record was filled by the latest change to this board not yet undone.
+    void undo(const Undo_record& undo_record);
     void set_lifetime_stats(const Board_lifetime_stats& new_board_lifetime_stats);
     void load_ancestral_data_with_current_data();
+    // Utility of the promising placement of b with the greatest key, or empty if there is none.
+    // Adds the placements tried to num_tried. Leaves this unchanged.
+    template <class Policy>
+    std::optional<Utility> get_best_utility_after_placing(const Block& b, long& num_tried);
 
 
     // Non-modifying
 
+    Packed pack() const;
+
     // Returns true iff this has strictly higher utility than other.
+    template <class Policy>
     bool has_greater_utility_than(const Board& other) const;
+    // a.get_utility_key() > b.get_utility_key() iff a.has_greater_utility_than(b).
+    // Compute once per board, then compare as often as needed.
+    template <class Policy>
+    Utility_key get_utility_key() const;
+    Utility_key get_utility_key() const;
+    // The utility key, with what it was built from.
+    template <class Policy>
+    Utility get_utility() const;
+    Utility get_utility() const;
+    // No board reachable from this one by at most num_placements placements,
+    // num_tetris_pieces of them Cyan, has a greater utility key than this.
+    // A learned evaluator's scores have no known bound, so the bound is the greatest key.
+    template <class Policy>
+    Utility_key get_utility_upper_bound(int num_placements, int num_tetris_pieces) const;
+    // Drop and score every legal column of one rotation of b, without modifying or copying this.
+    template <class Policy>
+    Rotation_scan scan_rotation(const Block& b, int rot_x) const;
+    Rotation_scan scan_rotation(const Block& b, int rot_x) const;
     int get_num_holes() const;
+    Features_t get_features() const;
     bool can_swap_block(const Block& b) const;
     bool is_holding_some_block() const;
+    bool is_holding(const Block& b) const;
+    // Null if nothing is held.
+    const Block* get_held_block() const;
+    // True iff other has the same cells, hold and swap status. That is all vision can see.
+    bool looks_the_same_as(const Board& other) const;
 
     int get_num_blocks_placed() const;
     double get_tetris_percent() const;
@@ -65,46 +300,91 @@ public:
 
     Board_lifetime_stats get_lifetime_stats() const;
 
+    // Identifies everything that affects searching below this board:
+    // cells, hold, lifetime stats that are compared, and ancestral data.
+    std::uint64_t get_search_key() const;
+
 private:
 
-    using Grid_t = std::bitset<c_size>;
+    // One word per row. Bit col_x of a row is the cell in column col_x.
+    using Row_t = std::uint16_t;
+    using Grid_t = std::array<Row_t, c_rows>;
+
+    static constexpr Row_t c_full_row = (1u << c_cols) - 1;
+
+    static constexpr int c_cells_per_block = 4;
+    static constexpr int c_max_rows_cleared_per_placement = 4;
+
+    template <class Policy>
+    Utility_fields get_utility_fields() const;
+    // Primary word of a utility key. Never decreases as any one field gets better.
+    static std::uint64_t pack_utility_fields(const Utility_fields& fields);
+    // Most rows that could be cleared in num_placements placements.
+    int get_max_rows_cleared(int num_placements) const;
+    // Fewest holes left after clearing num_rows_cleared rows, whichever they are.
+    int get_min_holes_after_clearing(int num_rows_cleared) const;
+
+    // The comparison get_utility_key() compiles. Kept to check the key against. See test_utility_key.cpp.
+    template <class Policy>
+    bool has_greater_utility_field_by_field(const Board& other) const;
+
+    // Vectorized where SSE2 is available.
+    static Height_stats compute_height_stats(const Height_map_t& heights);
+
+    // Width is the width of ch_map, known at compile time so contour loops unroll.
+    template <class Policy, int Width>
+    Rotation_scan scan_rotation(const CH_maps& ch_map) const;
 
     // FUNCTIONS
     // Modifying
 
-    void clear_row(int row);
+    // Left_bottom_row is where b lands. Sets cleared_rows as in Undo_record.
+    template <class Policy>
+    bool place_block(const Block& b, Placement p, int left_bottom_row, std::uint32_t& cleared_rows);
 
-    // (0, 0) is bottom left;  (1, 0) is 2nd row, 1st column;  (0, 1) is 1st row, 2nd column.
-    Grid_t::reference at(size_t row, size_t col);
+    // Remove every full row in [lowest_row, highest_row] in one pass, shifting everything above down.
+    // Returns a mask with bit row_x set iff row row_x was removed.
+    std::uint32_t clear_full_rows(int lowest_row, int highest_row);
+
+    void save_for_undo(Undo_record& undo_record) const;
 
     // Non-modifying
     // (0, 0) is bottom left;  (1, 0) is 2nd row, 1st column;  (0, 1) is 1st row, 2nd column.
     bool at(size_t row, size_t col) const;
     bool is_row_full(int row) const;
     int compute_height(size_t col_x) const;
+    template <class Policy>
     bool is_promising() const;
     bool has_good_trench_status() const;
+    // Holes above this height count against is_promising().
+    int get_hole_floor() const;
+    // Requires: highest_height is up to date.
     int num_holes_above_height(int height) const;
 
+    // Xor of the zobrist keys of the given cells of one row.
+    static std::uint64_t hash_cells(int row, Row_t cells);
+    std::uint64_t compute_zobrist_hash() const;
+
     // Given a block and placement, drop the block:
     // return the row idx of the left-bottom most cell of the block.
     int get_row_after_drop(const Block& b, Placement p) const;
 
-    int get_height_map_reduction(int deleted_row, int query_col) const;
-
     // Fundamental and Primary cache data must be up to date before calling update second/life cache.
-    void update_secondary_cache(int num_rows_cleared_just_now);
+    void update_secondary_cache();
     void update_lifetime_cache(int num_rows_cleared_just_now);
 
     // MEMBERS
     // === Fundamental ===
-    Grid_t board;
+    Grid_t board = {0};
 
     const Block* current_hold = nullptr;
     bool just_swapped = false;
 
-    // === Primary Cache. Should be updated in place_block() and clear_row() ===
-    std::array<int, c_cols> height_map = {0};
+    // Zobrist hash of the fundamental data. Updated incrementally wherever it changes.
+    std::uint64_t zobrist_hash = 0;
+
+    // === Primary Cache. Should be updated in place_block() and clear_full_rows() ===
+    alignas(16) Height_map_t height_map = {0};
     int num_cells_filled = 0;
     // If there are 0 holes, num_cells_filled will be equal to this.
     int perfect_num_cells_filled = 0;
@@ -113,7 +393,7 @@ private:
     /*
     // Cached second. Should be updated in update_secondary_cache().
     Update cache is responsible for the following.
-    None of these are ever read by place_block() or clear_row()
+    None of these are ever read by place_block() or clear_full_rows()
     */
     int num_trenches = 0;
     bool at_least_one_side_clear = true;
@@ -131,6 +411,11 @@ private:
     // === Ancestral Data. Choose carefully when to manipulate this. ===
     Ancestor_data ancestor_with_smallest_max_height;
 
+    // === Settings. Never changed by placing blocks. ===
+    const Board_settings* settings = &c_default_settings;
+
+    static const Board_settings c_default_settings;
+
 };
 
 
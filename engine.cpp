@@ -0,0 +1,358 @@
+#include "engine.h"
+#include "tetris_worker.h"
+
+#include <utility>
+#include <cassert>
+#include <algorithm>
+#include <iostream>
+
+using std::array;
+using std::vector;
+using std::unique_lock;
+using std::mutex;
+using std::move;
+using std::max_element;
+using std::min;
+using std::optional;
+using std::cout;
+using std::endl;
+
+Engine::Engine(int num_workers, const Board_settings& _board_settings)
+    : board_settings{_board_settings} {
+
+    for(int i = 0; i < num_workers; ++i){
+        workers.emplace_back(new Tetris_worker{*this, i});
+    }
+}
+
+Engine::~Engine(){
+    assert_all_free();
+    // Before anything the workers might touch is destroyed.
+    workers.clear();
+}
+
+void Engine::wait_until_all_free(){
+    unique_lock<mutex> search_ulock(search_mutex);
+    search_finished.wait(search_ulock, [this](){
+        return num_workers_searching == 0;
+    });
+}
+
+void Engine::assert_all_free(){
+
+    unique_lock<mutex> search_ulock(search_mutex);
+    assert(num_workers_searching == 0);
+}
+
+void Engine::print_workers_states(){
+
+    assert_all_free();
+
+    for(auto& worker : workers){
+        if(worker->best_state){
+            cout << "Here is a state a worker found:" << endl;
+            cout << *worker->best_state << endl;
+        }
+    }
+}
+
+bool Engine::distribute_new_work_and_wait_till_all_free(State&& root_state, const Search_limits& limits,
+        const vector<Placement>& expected_line, const optional<Chance_layer>& _chance_layer,
+        bool _keep_best_leaf_per_root_placement){
+
+    assert_all_free();
+
+    search_limits = limits;
+    num_states_considered = 0;
+    search_abandoned = false;
+    num_idle_workers = 0;
+    best_primary_found = 0;
+    chance_layer = _chance_layer;
+    keep_best_leaf_per_root_placement = _keep_best_leaf_per_root_placement;
+    num_chance_placements_tried = 0;
+    if(chance_layer){
+        ++chance_generation;
+    }
+
+    // Workers are parked, so we may act as the owner of their deques.
+    for(auto& worker : workers){
+        assert(worker->deque.looks_empty());
+        worker->deque.release_old_buffers();
+        worker->arena.reset();
+        worker->best_state = {};
+        worker->num_rejected = 0;
+        worker->num_leaves_scored = 0;
+        worker->num_hold_branches = 0;
+        worker->num_pruned = 0;
+        worker->scheduling_stats = {};
+        worker->num_expanded.fill(0);
+        worker->num_children.fill(0);
+        worker->num_transpositions.fill(0);
+        worker->best_leaf_by_root_placement.fill({});
+        if(chance_layer && worker->chance_cache.empty()){
+            worker->chance_cache.resize(size_t{1} << Tetris_worker::c_log2_chance_cache_entries);
+        }
+    }
+    transposition_table.new_search();
+
+    root_state.use_board_settings(board_settings);
+    root = &root_state;
+    // Workers are parked, so borrowing one is safe.
+    workers.front()->seed_best_primary_found(expected_line);
+
+    // Make first generation, best looking first. Kept around so its capacity is reused.
+    first_gen.clear();
+    root_placements.clear();
+    State::Placement_list_t placements;
+    const int num_placements = root_state.generate_ordered_placements(placements,
+        expected_line.empty() ? optional<Placement>{} : optional<Placement>{expected_line.front()});
+    for(int placement_x = 0; placement_x < num_placements; ++placement_x){
+        const Placement placement = placements[placement_x].placement;
+        optional<State> child = root_state.generate_child_from_placement(placement);
+        if(child){
+            first_gen.push_back(workers.front()->arena.create(child->compact(root_state)));
+            root_placements.push_back(placement);
+        }
+    }
+
+    // Deal work out like cards, so every worker starts on some of the best looking placements.
+    // Deques are stacks, so push the best looking last.
+    for(size_t state_x = first_gen.size(); state_x-- > 0;){
+        workers[state_x % workers.size()]->deque.push(first_gen[state_x]);
+    }
+
+    start_all_and_wait();
+
+    return !search_abandoned;
+}
+
+void Engine::run_on_every_worker(const std::function<void(int)>& _task){
+    assert_all_free();
+    task = &_task;
+    start_all_and_wait();
+    task = nullptr;
+}
+
+void Engine::start_all_and_wait(){
+
+    unique_lock<mutex> search_ulock(search_mutex);
+    num_workers_searching = workers.size();
+    search_ulock.unlock();
+
+    for(auto& worker : workers){
+        unique_lock<mutex> start_ulock(worker->start_mutex);
+        ++worker->search_generation;
+        start_ulock.unlock();
+        worker->search_started.notify_one();
+    }
+
+    wait_until_all_free();
+}
+
+long Engine::get_num_states_considered(){
+    assert_all_free();
+    return num_states_considered;
+}
+
+bool Engine::limit_reached(int num_just_considered){
+
+    const long num_considered = num_states_considered.fetch_add(num_just_considered, std::memory_order_relaxed)
+        + num_just_considered;
+
+    if(search_limits.node_budget && num_considered >= search_limits.node_budget){
+        return true;
+    }
+    return search_limits.deadline && std::chrono::steady_clock::now() >= *search_limits.deadline;
+}
+
+const optional<State>& Engine::get_best_reachable_state(){
+    return get_best_worker()->best_state;
+}
+
+Tetris_worker* Engine::get_best_worker(){
+    assert_all_free();
+    Tetris_worker* best_worker = max_element(workers.begin(), workers.end(),
+        [](const auto& w1, const auto& w2){
+            // Necessary because now a worker may not have any results to contribute.
+            bool w1_empty = !w1->best_state.has_value();
+            bool w2_empty = !w2->best_state.has_value();
+            if(w1_empty != w2_empty){
+                return w1_empty;
+            }
+            if(w1_empty && w2_empty){
+                return false; // arbitrary.
+            }
+            return w2->best_key > w1->best_key;
+    })->get();
+    return best_worker;
+}
+
+long Engine::get_num_states_pruned(){
+
+    assert_all_free();
+
+    long num_pruned = 0;
+    for(const auto& worker : workers){
+        num_pruned += worker->num_pruned;
+    }
+    return num_pruned;
+}
+
+vector<Worker_scheduling_stats> Engine::get_scheduling_stats(){
+
+    assert_all_free();
+
+    vector<Worker_scheduling_stats> scheduling_stats;
+    for(const auto& worker : workers){
+        scheduling_stats.push_back(worker->scheduling_stats);
+    }
+    return scheduling_stats;
+}
+
+Search_counters Engine::get_search_counters(){
+
+    assert_all_free();
+
+    Search_counters counters;
+    for(const auto& worker : workers){
+        for(int depth = 0; depth < Tetris_worker::c_max_tracked_depth; ++depth){
+            counters.num_expanded += worker->num_expanded[depth];
+            counters.num_children += worker->num_children[depth];
+        }
+        counters.num_rejected += worker->num_rejected;
+        counters.num_leaves_scored += worker->num_leaves_scored;
+        counters.num_hold_branches += worker->num_hold_branches;
+        counters.num_offloads += worker->scheduling_stats.num_steals;
+        // A stolen state is freed into the thief's arena, so arenas together never held more than they carved out.
+        counters.peak_states_waiting += worker->arena.get_num_slots_carved();
+    }
+    return counters;
+}
+
+long Engine::get_num_chance_placements_tried(){
+    assert_all_free();
+    return num_chance_placements_tried;
+}
+
+long Engine::take_num_heap_allocations(){
+
+    assert_all_free();
+
+    long num_heap_allocations = 0;
+    for(auto& worker : workers){
+        num_heap_allocations += worker->arena.take_num_heap_allocations();
+        num_heap_allocations += worker->deque.take_num_heap_allocations();
+    }
+    return num_heap_allocations;
+}
+
+optional<int> Engine::get_best_root_placement_rank(){
+    const optional<State>& best_state = get_best_reachable_state();
+    if(!best_state){
+        return {};
+    }
+    const Placement best_placement = best_state->get_placement_taken_from_root();
+    return static_cast<int>(std::find(root_placements.begin(), root_placements.end(), best_placement)
+        - root_placements.begin());
+}
+
+int Engine::get_num_root_placements(){
+    assert_all_free();
+    return static_cast<int>(root_placements.size());
+}
+
+optional<long> Engine::get_num_states_before_best_found(){
+    const Tetris_worker* best_worker = get_best_worker();
+    if(!best_worker->best_state){
+        return {};
+    }
+    return best_worker->num_considered_before_best;
+}
+
+vector<Scored_state> Engine::get_best_leaf_per_root_placement(int max_leaves){
+
+    assert_all_free();
+    assert(keep_best_leaf_per_root_placement);
+
+    using Scored_leaf = Tetris_worker::Scored_leaf;
+
+    // Ties go to the placement tried first, however many workers there are.
+    vector<const Scored_leaf*> best_leaves;
+    for(const Placement& placement : root_placements){
+        const Scored_leaf* best_leaf = nullptr;
+        for(const auto& worker : workers){
+            const auto& leaf = worker->best_leaf_by_root_placement[Tetris_worker::get_placement_index(placement)];
+            if(leaf && (!best_leaf || leaf->key > best_leaf->key)){
+                best_leaf = &*leaf;
+            }
+        }
+        if(best_leaf){
+            best_leaves.push_back(best_leaf);
+        }
+    }
+    std::stable_sort(best_leaves.begin(), best_leaves.end(), [](const Scored_leaf* l1, const Scored_leaf* l2){
+        return l1->key > l2->key;
+    });
+
+    vector<Scored_state> leaves;
+    for(size_t leaf_x = 0; leaf_x < min(best_leaves.size(), static_cast<size_t>(max_leaves)); ++leaf_x){
+        leaves.push_back({best_leaves[leaf_x]->key, State{best_leaves[leaf_x]->state, *root}});
+    }
+    return leaves;
+}
+
+Transposition_stats Engine::get_transposition_stats(){
+
+    assert_all_free();
+    constexpr int c_max_tracked_depth = Tetris_worker::c_max_tracked_depth;
+
+    array<long, c_max_tracked_depth> num_expanded = {0};
+    array<long, c_max_tracked_depth> num_children = {0};
+    array<long, c_max_tracked_depth> num_transpositions = {0};
+    for(const auto& worker : workers){
+        for(int depth = 0; depth < c_max_tracked_depth; ++depth){
+            num_expanded[depth] += worker->num_expanded[depth];
+            num_children[depth] += worker->num_children[depth];
+            num_transpositions[depth] += worker->num_transpositions[depth];
+        }
+    }
+
+    Transposition_stats stats;
+    // A leaf is a subtree of one node.
+    double subtree_size = 1;
+    for(int depth = 1; depth < c_max_tracked_depth; ++depth){
+        if(num_expanded[depth]){
+            const double branching = static_cast<double>(num_children[depth]) / num_expanded[depth];
+            subtree_size = 1 + branching * subtree_size;
+        }
+        stats.hits += num_transpositions[depth];
+        stats.probes += num_transpositions[depth] + num_expanded[depth];
+        stats.nodes_saved += static_cast<long>(num_transpositions[depth] * subtree_size);
+    }
+    return stats;
+}
+
+Search_counters& Search_counters::operator+=(const Search_counters& other){
+    num_expanded += other.num_expanded;
+    num_children += other.num_children;
+    num_rejected += other.num_rejected;
+    num_leaves_scored += other.num_leaves_scored;
+    num_hold_branches += other.num_hold_branches;
+    num_offloads += other.num_offloads;
+    peak_states_waiting = std::max(peak_states_waiting, other.peak_states_waiting);
+    return *this;
+}
+
+std::ostream& operator<<(std::ostream& os, const Search_counters& counters){
+    return os << "Counters: " << counters.num_expanded << " expanded, " << counters.num_children << " children ("
+        << counters.num_rejected << " rejected, " << counters.num_hold_branches << " holds), "
+        << counters.num_leaves_scored << " leaves scored, " << counters.num_offloads << " offloads, peak "
+        << counters.peak_states_waiting << " states waiting";
+}
+
+void Engine::publish_leaf_found(const Utility_key& key){
+    uint64_t best_primary = best_primary_found.load(std::memory_order_relaxed);
+    while(key.primary > best_primary
+            && !best_primary_found.compare_exchange_weak(best_primary, key.primary, std::memory_order_relaxed)){
+    }
+}
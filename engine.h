@@ -0,0 +1,253 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <iosfwd>
+
+#include "state.h"
+#include "transposition_table.h"
+
+class Tetris_worker;
+
+// How much the transposition table helped during the last search.
+struct Transposition_stats {
+    long probes = 0;
+    long hits = 0;
+    // Estimated from the average subtree size at each remaining depth.
+    long nodes_saved = 0;
+
+    double get_hit_percent() const {
+        return probes ? static_cast<double>(hits) / probes * 100 : 0;
+    }
+};
+
+// Workers abandon a search once either limit is reached.
+struct Search_limits {
+    // Empty for no deadline.
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    // Limit on states considered. 0 for no limit.
+    long node_budget = 0;
+};
+
+// One ply of expectation past the queue. A leaf the queue ran out under, with placements to spare,
+// is scored by the average, over every block that may come next, of the best key placing it can reach.
+struct Chance_layer {
+    // Bit block.index is set iff that block may come next. See Bag_tracker.
+    std::uint8_t possible_blocks = 0;
+    // Placements tried while scoring such leaves, after which the search is abandoned.
+    long budget = 0;
+};
+
+// How one worker shared work with the others during a search.
+// Workers share by pushing states onto their own deque, for anyone idle to steal.
+struct Worker_scheduling_stats {
+    // States pushed onto this worker's deque, so others could steal them.
+    long num_states_shared = 0;
+    // States this worker stole from others. Each carries its whole subtree with it.
+    long num_steals = 0;
+    // Steals from deques that looked non-empty, that came back empty because someone else got there first.
+    long num_lost_steal_races = 0;
+    // With an empty deque, looking for something to steal.
+    std::chrono::nanoseconds idle_time{0};
+    // Blocked on the engine's search mutex, reporting the search finished.
+    std::chrono::nanoseconds lock_wait_time{0};
+};
+
+// What the workers did during one search. Each worker counts its own, and the engine sums them once it finishes.
+struct Search_counters {
+    // States whose children were generated.
+    long num_expanded = 0;
+    // Children made, leaves included.
+    long num_children = 0;
+    // Placements not made into children because they were not promising, or topped out.
+    long num_rejected = 0;
+    // Leaves scored against the best leaf found so far.
+    long num_leaves_scored = 0;
+    // Children made by holding.
+    long num_hold_branches = 0;
+    // States stolen from one worker by another, each carrying its whole subtree.
+    long num_offloads = 0;
+    // Most states waiting to be searched at once. Exact with one worker, an upper bound with more.
+    long peak_states_waiting = 0;
+
+    // Sums counts, and keeps the greater peak.
+    Search_counters& operator+=(const Search_counters& other);
+};
+
+// One line, for the per turn report.
+std::ostream& operator<<(std::ostream& os, const Search_counters& counters);
+
+// A leaf and the utility key it was compared by.
+struct Scored_state {
+    Utility_key key;
+    State state;
+};
+
+// A pool of Tetris_workers, and the search they share. Searches for the best state reachable from a root.
+// Engines share nothing, so several can search at once, each driven by its own thread.
+// One engine runs one search at a time, driven by one thread.
+class Engine {
+
+public:
+
+    // Starts num_workers worker threads. Every board searched is scored and pruned by board_settings.
+    explicit Engine(int num_workers, const Board_settings& board_settings = {});
+    // Requires: Workers are free.
+    // Stops every worker and waits for it to exit.
+    ~Engine();
+
+    void wait_until_all_free();
+    void assert_all_free();
+    void print_workers_states();
+
+    // Gives work to all threads and marks them all as not free.
+    // Root_state uses this engine's board settings from now on.
+    // Expected_line is the line of placements from the root the caller expects is best, as far as it goes.
+    // Following it to a leaf first gives the search a bound to prune against from the start.
+    // Only the bound is kept, so the best reachable state is the same whatever the line.
+    // Root placements are searched best looking first, starting with the expected line's first.
+    // Returns true iff the search completed. Otherwise a limit was hit, all work was dropped,
+    // and the best reachable state is only the best of what was seen.
+    // Chance_layer, if given, scores leaves past the queue by expectation. See Chance_layer.
+    // If keep_best_leaf_per_root_placement, see get_best_leaf_per_root_placement().
+    bool distribute_new_work_and_wait_till_all_free(State&& root_state, const Search_limits& limits = {},
+        const std::vector<Placement>& expected_line = {}, const std::optional<Chance_layer>& chance_layer = {},
+        bool keep_best_leaf_per_root_placement = false);
+
+    // Requires: Workers are free.
+    // Runs task(worker_index) on every worker at once, instead of searching, and waits for them all to finish.
+    void run_on_every_worker(const std::function<void(int)>& task);
+
+    int get_num_workers() const {
+        return static_cast<int>(workers.size());
+    }
+
+    // Lives as long as this engine. Boards that use it must not outlive it.
+    const Board_settings& get_board_settings() const {
+        return board_settings;
+    }
+
+    // Requires: Workers are free and they just finished doing work.
+    // States considered during the last search.
+    long get_num_states_considered();
+
+    // Requires: Workers are free and they just finished doing work.
+    // Empty if no leaf was scored, because no root placement could be made or a limit was hit first.
+    const std::optional<State>& get_best_reachable_state();
+
+    // Requires: Workers are free and they just finished a search that kept the best leaf per root placement.
+    // The best leaf found below each root placement, for the max_leaves best of them, best first.
+    // Subtrees pruned, or searched below another root placement first, are not seen again,
+    // so only the overall best is sure to be the best below its root placement.
+    std::vector<Scored_state> get_best_leaf_per_root_placement(int max_leaves);
+
+    // Requires: Workers are free and they just finished doing work.
+    Transposition_stats get_transposition_stats();
+
+    // Requires: Workers are free and they just finished doing work.
+    // Where the best state's placement from the root was in the order root placements were tried. 0 is first.
+    // Empty if there is no best state.
+    std::optional<int> get_best_root_placement_rank();
+
+    // Requires: Workers are free and they just finished doing work.
+    // Root placements tried during the last search.
+    int get_num_root_placements();
+
+    // Requires: Workers are free and they just finished doing work.
+    // States considered, by all workers, before the best state was found. Exact with one worker.
+    // Empty if there is no best state.
+    std::optional<long> get_num_states_before_best_found();
+
+    // Requires: Workers are free and they just finished doing work.
+    // States dropped during the last search because no leaf below them could beat a leaf already found.
+    long get_num_states_pruned();
+
+    // Requires: Workers are free and they just finished doing work.
+    // What the workers did during the last search, summed over them.
+    Search_counters get_search_counters();
+
+    // Requires: Workers are free and they just finished doing work.
+    // Placements tried while scoring leaves by expectation during the last search.
+    long get_num_chance_placements_tried();
+
+    // Requires: Workers are free and they just finished doing work.
+    // How each worker shared work during the last search, by worker index.
+    std::vector<Worker_scheduling_stats> get_scheduling_stats();
+
+    // Requires: Workers are free.
+    // Heap allocations made by the search since this was last called. 0 once warmed up.
+    long take_num_heap_allocations();
+
+    Engine(const Engine& other) = delete;
+    Engine& operator=(const Engine& other) = delete;
+
+private:
+
+    friend class Tetris_worker;
+
+    // Requires: Workers are free.
+    // Wakes every worker, and waits for them all to finish.
+    void start_all_and_wait();
+
+    // Requires: Workers are free and they just finished doing work.
+    // The worker whose best state is best. Its best state is empty iff every worker's is.
+    Tetris_worker* get_best_worker();
+
+    // Returns true iff the search should be abandoned, after considering this many more states.
+    bool limit_reached(int num_just_considered);
+
+    // Raise best_primary_found to key's, if lower.
+    void publish_leaf_found(const Utility_key& key);
+
+    // 8 MiB.
+    static constexpr int c_log2_transposition_buckets = 16;
+
+    const Board_settings board_settings;
+
+    std::vector<std::unique_ptr<Tetris_worker>> workers;
+
+    // === Search lifetime. Only touched once per search per worker. ===
+    std::mutex search_mutex;
+    // The master waits for num_workers_searching to reach 0.
+    std::condition_variable search_finished;
+    int num_workers_searching = 0;
+    // Run by workers instead of searching, if set. Workers see it through their start_mutex.
+    const std::function<void(int)>* task = nullptr;
+
+    // A worker is idle when its own deque is empty and it is not holding a stolen state.
+    // When all workers are idle at once, there is no work left anywhere.
+    std::atomic<int> num_idle_workers{0};
+
+    Transposition_table transposition_table{c_log2_transposition_buckets};
+
+    // Only touched by the master, while handing out work.
+    std::vector<Compact_state*> first_gen;
+    // Placements from the root, in the order they were handed out.
+    std::vector<Placement> root_placements;
+    // Queue positions of compact states are relative to this. Lives until the search finishes.
+    const State* root = nullptr;
+
+    // Set before work is handed out, so workers see them through search_mutex.
+    Search_limits search_limits;
+    std::atomic<long> num_states_considered{0};
+    // Once set, everyone drops their work without considering it.
+    std::atomic<bool> search_abandoned{false};
+    // Greatest primary utility key of any leaf found so far this search, by any worker.
+    std::atomic<std::uint64_t> best_primary_found{0};
+    // Set before work is handed out, like search_limits.
+    std::optional<Chance_layer> chance_layer;
+    std::atomic<long> num_chance_placements_tried{0};
+    bool keep_best_leaf_per_root_placement = false;
+    // Chance cache entries from other searches are stale. Only changed by the master.
+    std::uint32_t chance_generation = 0;
+};
+
+#endif
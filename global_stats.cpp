@@ -1,3 +0,0 @@
-#include "global_stats.h"
-
-long gs_num_comparisons = 0;
\ No newline at end of file
@@ -1,7 +0,0 @@
-#ifndef GLOBAL_STATS_H
-#define GLOBAL_STATS_H
-
-extern long gs_num_comparisons;
-
-
-#endif
\ No newline at end of file
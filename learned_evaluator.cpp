@@ -0,0 +1,94 @@
+#include "learned_evaluator.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_TARGET
+#endif
+
+using std::int16_t;
+using std::int32_t;
+using std::int64_t;
+using std::string;
+using std::runtime_error;
+
+#ifdef HAVE_AVX2_TARGET
+// Compiled for AVX2 whatever the build flags. Only called once the CPU is known to have it.
+__attribute__((target("avx2")))
+static int64_t dot_avx2(const int16_t* features, const int16_t* weights){
+
+    static_assert(Board::c_padded_features % 16 == 0, "Features fill whole AVX2 registers.");
+
+    __m256i sums = _mm256_setzero_si256();
+    for(size_t feature_x = 0; feature_x < Board::c_padded_features; feature_x += 16){
+        const __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(features + feature_x));
+        const __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + feature_x));
+        // Products of adjacent pairs, summed into 32 bit lanes. Features are never negative, so a pair
+        // sums to at most 2 * 32767 * 32768 in magnitude and fits. Widened to 64 bit lanes before summing on.
+        const __m256i pairs = _mm256_madd_epi16(f, w);
+        sums = _mm256_add_epi64(sums, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(pairs)));
+        sums = _mm256_add_epi64(sums, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(pairs, 1)));
+    }
+    const __m128i folded = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return _mm_cvtsi128_si64(folded) + _mm_extract_epi64(folded, 1);
+}
+#endif
+
+static int64_t dot_scalar(const int16_t* features, const int16_t* weights){
+    int64_t sum = 0;
+    for(size_t feature_x = 0; feature_x < Board::c_num_features; ++feature_x){
+        sum += static_cast<int32_t>(features[feature_x]) * weights[feature_x];
+    }
+    return sum;
+}
+
+Learned_evaluator::Learned_evaluator(const string& path, bool allow_vectorized){
+
+    std::ifstream weights_file{path};
+    if(!weights_file){
+        throw runtime_error{"Cannot open evaluator weights: " + path};
+    }
+
+    size_t num_weights = 0;
+    string line;
+    while(getline(weights_file, line)){
+        std::istringstream line_stream{line.substr(0, line.find('#'))};
+        long weight;
+        while(line_stream >> weight){
+            if(num_weights == Board::c_num_features){
+                throw runtime_error{"Too many evaluator weights in " + path};
+            }
+            if(weight < std::numeric_limits<int16_t>::min() || weight > std::numeric_limits<int16_t>::max()){
+                throw runtime_error{"Evaluator weights must fit in 16 bits: " + std::to_string(weight)};
+            }
+            weights[num_weights++] = static_cast<int16_t>(weight);
+        }
+        if(!line_stream.eof()){
+            throw runtime_error{"Evaluator weights must be integers: " + line};
+        }
+    }
+    if(num_weights != Board::c_num_features){
+        throw runtime_error{"Expected " + std::to_string(Board::c_num_features) + " evaluator weights in " + path
+            + ", found " + std::to_string(num_weights)};
+    }
+
+#ifdef HAVE_AVX2_TARGET
+    use_avx2 = allow_vectorized && __builtin_cpu_supports("avx2");
+#else
+    (void)allow_vectorized;
+    use_avx2 = false;
+#endif
+}
+
+int64_t Learned_evaluator::evaluate(const Board::Features_t& features) const {
+#ifdef HAVE_AVX2_TARGET
+    if(use_avx2){
+        return dot_avx2(features.data(), weights.data());
+    }
+#endif
+    return dot_scalar(features.data(), weights.data());
+}
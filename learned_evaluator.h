@@ -0,0 +1,36 @@
+#ifndef LEARNED_EVALUATOR_H
+#define LEARNED_EVALUATOR_H
+
+#include "board.h"
+
+#include <cstdint>
+#include <string>
+
+// Scores boards with a linear model over Board::get_features(), in 16 bit fixed point, instead of the
+// hand-written utility. Weights come from a file, so strategies can be tried without recompiling.
+// Scoring is one dot product, vectorized with AVX2 when the CPU has it.
+class Learned_evaluator {
+
+public:
+
+    // Reads Board::c_num_features integer weights, in feature order, from the file at path.
+    // Anything from a # to the end of its line is a comment.
+    // Throws runtime_error if the file cannot be read, or does not hold exactly that many 16 bit weights.
+    // Allow_vectorized false forces the scalar dot product, for comparison.
+    explicit Learned_evaluator(const std::string& path, bool allow_vectorized = true);
+
+    // Greater is better. Summed in 64 bits, so no weights overflow it.
+    std::int64_t evaluate(const Board::Features_t& features) const;
+
+    bool is_vectorized() const {
+        return use_avx2;
+    }
+
+private:
+
+    // Zero past Board::c_num_features, like the features.
+    alignas(32) Board::Features_t weights = {0};
+    bool use_avx2;
+};
+
+#endif
@@ -3,10 +3,11 @@
 #include "block.h"
 #include "action.h"
 #include "utility.h"
-#include "tetris_worker.h"
+#include "engine.h"
 #include "play_settings.h"
-#include "global_stats.h"
 #include "post_play.h"
+#include "learned_evaluator.h"
+#include "player.h"
 
 #include <iostream>
 #include <cassert>
@@ -15,8 +16,18 @@
 #include <string>
 #include <utility>
 #include <optional>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <numeric>
+#include <fstream>
+#include <stdexcept>
 
 using std::swap;
+using std::min;
+using std::max;
 using std::move;
 using std::endl;
 using std::cin;
@@ -25,19 +36,43 @@ using std::string;
 using std::back_inserter;
 using std::transform;
 using std::optional;
+using std::vector;
+using std::chrono::steady_clock;
+using std::chrono::microseconds;
+using std::chrono::duration_cast;
 
 using Tetris_queue_t = State::Tetris_queue_t;
 using Seed_t = Random_block_generator::Seed_t;
 
-void play(const Play_settings& settings);
-void play_99(const Play_settings& settings);
-Post_play_report play_99_move(Game_state& original_state, const Play_settings& settings);
-
-Placement get_best_move(
-        Board& board,
-        const Block& presented,
-        const Tetris_queue_t& queue,
-        int num_placements_to_look_ahead);
+// How one game went.
+struct Game_result {
+    int turns_played = 0;
+    // Ended early, with no placement that did not top out.
+    bool died = false;
+    Board_lifetime_stats lifetime_stats;
+    double tetris_percent = 0;
+    long states_considered = 0;
+    Search_counters counters;
+    microseconds search_time{0};
+    long rollouts_played = 0;
+    microseconds rollout_time{0};
+};
+
+void play(Player& player, const Play_settings& settings);
+// Plays up to settings.game_length turns, with blocks from block_generator.
+// Prints each search, and each board if settings.board_log, iff show_turns.
+Game_result play_game(Player& player, const Play_settings& settings, Block_generator& block_generator,
+    bool show_turns);
+// Plays settings.games games, the first dealt settings.seed and each next one the seed after,
+// settings.game_threads at a time with a player each, searching with board_settings.
+// Nothing is printed until every game is over.
+// Then prints a summary, and writes it with every game's result to settings.summary.
+void play_batch(const Play_settings& settings, const Board_settings& board_settings);
+void play_99(Player& player, const Play_settings& settings);
+// Expected_line is what the previous move's search expected to play from here. Updated for the next move.
+// Empty iff there is no move to make, because every placement tops out.
+optional<Post_play_report> play_99_move(Player& player, Game_state& original_state, const Play_settings& settings,
+    vector<Placement>& expected_line);
 
 int main(int argc, char* argv[]) {
 
@@ -55,17 +90,27 @@ int main(int argc, char* argv[]) {
 
     Play_settings ps(argc, argv);
     Output_manager::get_instance().set_streams(ps.mode);
-    // ps.wait_for_controller_connection_if_necessary();
+    Board_settings board_settings{ps.policy, ps.pruning_rules, nullptr};
 
-    Tetris_worker::create_workers(ps.num_threads);
-    // Wait for them to spin up and mark themselves free for work.
-    Tetris_worker::wait_until_all_free();
+    optional<Learned_evaluator> learned_evaluator;
+    if(ps.evaluator == Evaluator::learned){
+        learned_evaluator.emplace(ps.weights);
+        board_settings.learned_evaluator = &*learned_evaluator;
+    }
+    // ps.wait_for_controller_connection_if_necessary();
 
-    if(ps.is_watching()){
-        play(ps);
+    if(ps.is_batch()){
+        play_batch(ps, board_settings);
     }
     else{
-        play_99(ps);
+        Player player{ps, board_settings};
+
+        if(ps.is_watching()){
+            play(player, ps);
+        }
+        else{
+            play_99(player, ps);
+        }
     }
 
     // Not bothering with unique_ptr
@@ -73,42 +118,88 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
-void play(const Play_settings& settings){
+void play(Player& player, const Play_settings& settings){
+
+    const Game_result result = play_game(player, settings, *settings.block_generator, true);
+
+    cout << "Turns played: " << result.turns_played << endl;
+    cout << "Leaves scored per turn: "
+        << (result.turns_played ? static_cast<double>(result.counters.num_leaves_scored) / result.turns_played : 0) << endl;
+    cout << "Tetris percent: " << result.tetris_percent << " %" << endl;
+    cout << "Ms per move: "
+        << (result.turns_played ? result.search_time.count() / 1000.0 / result.turns_played : 0) << endl;
+    if(result.rollouts_played){
+        cout << "Rollouts per second: " << get_rollouts_per_second(result.rollouts_played, result.rollout_time) << endl;
+    }
+}
+
+Game_result play_game(Player& player, const Play_settings& settings, Block_generator& block_generator,
+        bool show_turns){
 
     Board board;
-    const Block* next_to_present = settings.block_generator->generate();
+    // Every block dealt goes through here, so we know what the bag has left.
+    Bag_tracker bag_tracker;
+    const auto generate = [&block_generator, &bag_tracker](){
+        const Block* b = block_generator.generate();
+        bag_tracker.observe(*b);
+        return b;
+    };
+    const bool show_boards = show_turns && settings.board_log;
+
+    const Block* next_to_present = generate();
     Tetris_queue_t queue;
     for(int i = 0; i < settings.queue_size; ++i){
-        // Not going to write a wrapper just for this.
-        // generate_n takes functor by value. Can't use bc we use inheritance. Use ref()?
-        queue.push_back(settings.block_generator->generate());
+        queue.push_back(generate());
     }
 
-    int turn = 0;
+    // Nothing unexpected happens while watching, so the search's predictions always hold.
+    vector<Placement> expected_line;
+    Game_result result;
+    int& turn = result.turns_played;
     while(turn < settings.game_length){
 
-        cout << "Comparisons: " << gs_num_comparisons << endl;
-
         // Status
-        if(settings.board_log){
+        if(show_boards){
             Output_manager::get_instance().get_board_os()
                 << "Turn: " << turn << "\n"
                 << "Tetris percent:" << board.get_tetris_percent() << " %" << "\n"
                 << "Presented with: " << next_to_present->name << "\n";
         }
 
-        Placement next_placement = get_best_move(
-            board, *next_to_present,
-            queue, settings.lookahead_placements
+        const optional<Search_result> best_move = get_best_move(
+            player, board, *next_to_present,
+            queue, bag_tracker.get_possible_next(), settings, expected_line
         );
+        if(!best_move){
+            if(show_boards){
+                Output_manager::get_instance().get_board_os() << "Game over :(" << endl;
+            }
+            result.died = true;
+            break;
+        }
+        const Search_result& search_result = *best_move;
+        const Placement next_placement = search_result.placement;
+        expected_line = search_result.expected_line_after;
+        result.states_considered += search_result.states_considered;
+        result.counters += search_result.counters;
+        result.search_time += search_result.time_used;
+        result.rollouts_played += search_result.rollouts_played;
+        result.rollout_time += search_result.rollout_time;
+
+        if(show_turns){
+            cout << search_result;
+            if(settings.engine == Search_engine::dfs){
+                const Transposition_stats transposition_stats = player.engine.get_transposition_stats();
+                cout << "Transpositions: " << transposition_stats.hits << " of "
+                    << transposition_stats.probes << " probes ("
+                    << transposition_stats.get_hit_percent() << " %), ~"
+                    << transposition_stats.nodes_saved << " nodes saved" << endl;
+            }
+            cout << "Heap allocations during search: " << player.engine.take_num_heap_allocations() << endl;
+        }
 
         Board new_board{board};
 
-        if(!settings.is_watching()){
-            Action action{next_to_present, next_placement};
-            Output_manager::get_instance().get_command_os() << action;
-        }
-
         // HOLD
         if(next_placement.get_is_hold()){
 
@@ -116,7 +207,7 @@ void play(const Play_settings& settings){
             if(!old_hold){
                 next_to_present = queue.front();
                 queue.pop_front();
-                queue.push_back(settings.block_generator->generate());
+                queue.push_back(generate());
             }
             else{
                 next_to_present = old_hold;
@@ -127,31 +218,131 @@ void play(const Play_settings& settings){
             bool is_promising = new_board.place_block(*next_to_present, next_placement);
 
             if(!is_promising){
-                if(settings.board_log){
+                if(show_boards){
                     Output_manager::get_instance().get_board_os() << "Game over :(" << endl;
                 }
-                return;
+                result.died = true;
+                break;
             }
             next_to_present = queue.front();
             queue.pop_front();
-            queue.push_back(settings.block_generator->generate());
+            queue.push_back(generate());
         }
 
         swap(board, new_board);
-        if(settings.board_log){
+        if(show_boards){
             Output_manager::get_instance().get_board_os() << "\n" << board << endl;
         }
         ++turn;
     }
 
-    cout << "Comparisons per turn: " << static_cast<double>(gs_num_comparisons) / settings.game_length << endl;
+    result.lifetime_stats = board.get_lifetime_stats();
+    result.tetris_percent = board.get_tetris_percent();
+    return result;
 }
 
+void play_batch(const Play_settings& settings, const Board_settings& board_settings){
+
+    const int num_game_threads = min(settings.games,
+        settings.game_threads ? settings.game_threads : max(1, static_cast<int>(std::thread::hardware_concurrency())));
+
+    vector<Game_result> results(settings.games);
+    // Game threads take the next game to play from here.
+    std::atomic<int> next_game_x{0};
 
-void play_99(const Play_settings& settings) {
+    const auto start_time = steady_clock::now();
+    vector<std::thread> game_threads;
+    for(int thread_x = 0; thread_x < num_game_threads; ++thread_x){
+        game_threads.emplace_back([&settings, &board_settings, &results, &next_game_x](){
+            Player player{settings, board_settings};
+            for(int game_x = next_game_x++; game_x < settings.games; game_x = next_game_x++){
+                Random_block_generator block_generator{settings.seed + static_cast<Seed_t>(game_x)};
+                results[game_x] = play_game(player, settings, block_generator, false);
+            }
+        });
+    }
+    for(auto& game_thread : game_threads){
+        game_thread.join();
+    }
+    const double seconds = duration_cast<microseconds>(steady_clock::now() - start_time).count() / 1e6;
+
+    long total_turns = 0;
+    long total_states = 0;
+    int num_deaths = 0;
+    int total_all_clears = 0;
+    vector<double> tetris_percents;
+    for(const auto& result : results){
+        total_turns += result.turns_played;
+        total_states += result.states_considered;
+        num_deaths += result.died;
+        total_all_clears += result.lifetime_stats.num_all_clears;
+        tetris_percents.push_back(result.tetris_percent);
+    }
+    std::sort(tetris_percents.begin(), tetris_percents.end());
+    const auto get_percentile = [&tetris_percents](int percentile){
+        return tetris_percents[(tetris_percents.size() - 1) * percentile / 100];
+    };
+    const double mean_tetris_percent =
+        std::accumulate(tetris_percents.begin(), tetris_percents.end(), 0.0) / settings.games;
+    const double death_percent = 100.0 * num_deaths / settings.games;
+    const Seed_t last_seed = settings.seed + static_cast<Seed_t>(settings.games - 1);
+
+    cout << "Games: " << settings.games << " (seeds " << settings.seed << " to " << last_seed << "), "
+        << num_game_threads << " at a time with " << settings.num_threads << " workers each, in " << seconds << " s\n"
+        << "Games per second: " << settings.games / seconds << "\n"
+        << "Moves per second: " << total_turns / seconds << "\n"
+        << "Nodes per second: " << total_states / seconds << "\n"
+        << "Tetris percent: mean " << mean_tetris_percent << ", min " << tetris_percents.front()
+        << ", p10 " << get_percentile(10) << ", median " << get_percentile(50) << ", p90 " << get_percentile(90)
+        << ", max " << tetris_percents.back() << "\n"
+        << "All clears: " << total_all_clears << "\n"
+        << "Deaths: " << num_deaths << " (" << death_percent << " %)" << endl;
+
+    std::ofstream summary{settings.summary};
+    if(!summary){
+        throw std::runtime_error{"Cannot write batch summary: " + settings.summary};
+    }
+    summary << "{\n"
+        << "  \"games\": " << settings.games << ",\n"
+        << "  \"first_seed\": " << settings.seed << ",\n"
+        << "  \"game_length\": " << settings.game_length << ",\n"
+        << "  \"lookahead\": " << settings.lookahead_placements << ",\n"
+        << "  \"queue_size\": " << settings.queue_size << ",\n"
+        << "  \"game_threads\": " << num_game_threads << ",\n"
+        << "  \"workers_per_game\": " << settings.num_threads << ",\n"
+        << "  \"seconds\": " << seconds << ",\n"
+        << "  \"games_per_second\": " << settings.games / seconds << ",\n"
+        << "  \"moves_per_second\": " << total_turns / seconds << ",\n"
+        << "  \"nodes_per_second\": " << total_states / seconds << ",\n"
+        << "  \"tetris_percent\": {\"mean\": " << mean_tetris_percent << ", \"min\": " << tetris_percents.front()
+        << ", \"p10\": " << get_percentile(10) << ", \"median\": " << get_percentile(50)
+        << ", \"p90\": " << get_percentile(90) << ", \"max\": " << tetris_percents.back() << "},\n"
+        << "  \"all_clears\": " << total_all_clears << ",\n"
+        << "  \"deaths\": " << num_deaths << ",\n"
+        << "  \"death_percent\": " << death_percent << ",\n"
+        << "  \"per_game\": [\n";
+    for(int game_x = 0; game_x < settings.games; ++game_x){
+        const Game_result& result = results[game_x];
+        summary << "    {\"seed\": " << settings.seed + static_cast<Seed_t>(game_x)
+            << ", \"turns\": " << result.turns_played
+            << ", \"died\": " << (result.died ? "true" : "false")
+            << ", \"tetris_percent\": " << result.tetris_percent
+            << ", \"tetrises\": " << result.lifetime_stats.num_tetrises
+            << ", \"all_clears\": " << result.lifetime_stats.num_all_clears
+            << ", \"states_considered\": " << result.states_considered
+            << ", \"search_ms\": " << result.search_time.count() / 1000.0 << "}"
+            << (game_x + 1 < settings.games ? ",\n" : "\n");
+    }
+    summary << "  ]\n}" << endl;
+    cout << "Summary written to " << settings.summary << endl;
+}
+
+void play_99(Player& player, const Play_settings& settings) {
 
     optional<Post_play_report> post_play_report;
     Board_lifetime_stats lifetime_stats;
+    // Kept from one move's search to the next, while the game goes as predicted.
+    vector<Placement> expected_line;
 
     while(true){
 
@@ -178,9 +369,16 @@ void play_99(const Play_settings& settings) {
         if(replace_board){
             vision_state.game_state.board = post_play_report->board;
         }
+        else if(post_play_report && !vision_state.game_state.board.looks_the_same_as(post_play_report->board)){
+            // Something we did not predict, like garbage rows. What the last search expected no longer applies.
+            expected_line.clear();
+        }
 
         vision_state.game_state.board.set_lifetime_stats(lifetime_stats);
-        post_play_report = play_99_move(vision_state.game_state, settings);
+        post_play_report = play_99_move(player, vision_state.game_state, settings, expected_line);
+        if(!post_play_report){
+            return;
+        }
         lifetime_stats = post_play_report->board.get_lifetime_stats();
 
         if(post_play_report->just_held_non_first){
@@ -196,7 +394,10 @@ void play_99(const Play_settings& settings) {
                 post_play_report->board
             };
 
-            post_play_report = play_99_move(post_hold_game_state, settings);
+            post_play_report = play_99_move(player, post_hold_game_state, settings, expected_line);
+            if(!post_play_report){
+                return;
+            }
             lifetime_stats = post_play_report->board.get_lifetime_stats();
         }
 
@@ -205,7 +406,8 @@ void play_99(const Play_settings& settings) {
 
 // Original_state is what the c++ will actually act on.
 // Assumes: At call time, original_state's lifetime stats are up to date.
-Post_play_report play_99_move(Game_state& original_state, const Play_settings& settings){
+optional<Post_play_report> play_99_move(Player& player, Game_state& original_state, const Play_settings& settings,
+        vector<Placement>& expected_line){
 
     string queue_str;
     transform(
@@ -226,14 +428,27 @@ Post_play_report play_99_move(Game_state& original_state, const Play_settings& s
     }
 
     // Compute placement
-    Placement next_placement = get_best_move(
+    // Vision only sees the queue, not where the bag starts, so any block may come after it.
+    const optional<Search_result> best_move = get_best_move(
+        player,
         original_state.board,
         *original_state.presented,
         original_state.queue,
-        settings.lookahead_placements);
+        Bag_tracker::c_full_bag,
+        settings,
+        expected_line);
+    if(!best_move){
+        if(settings.board_log){
+            Output_manager::get_instance().get_board_os() << "Every placement tops out. Game over :(" << endl;
+        }
+        return {};
+    }
+    const Search_result& search_result = *best_move;
+    const Placement next_placement = search_result.placement;
+    expected_line = search_result.expected_line_after;
 
     if(settings.board_log){
-        Output_manager::get_instance().get_board_os() << "Time to press buttons:\n";
+        Output_manager::get_instance().get_board_os() << search_result << "Time to press buttons:\n";
     }
 
     // Send Command
@@ -281,30 +496,3 @@ Post_play_report play_99_move(Game_state& original_state, const Play_settings& s
         just_cleared_line
     };
 }
-
-Placement get_best_move(
-        Board& board,
-        const Block& presented,
-        const Tetris_queue_t& queue,
-        int num_placements_to_look_ahead){
-
-
-    board.load_ancestral_data_with_current_data();
-
-    Tetris_worker::assert_all_free();
-
-    State root_state = State::generate_root_state(
-        board, presented, queue, num_placements_to_look_ahead);
-
-    Tetris_worker::distribute_new_work_and_wait_till_all_free(move(root_state));
-
-    State& best_state = Tetris_worker::get_best_reachable_state();
-
-    // Tetris_worker::print_workers_states();
-
-    // cout << "This is the worst board I can imagine!\n";
-    // cout << best_state << "\n";
-
-    return best_state.get_placement_taken_from_root();
-}
-
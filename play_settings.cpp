@@ -9,6 +9,7 @@
 #include <string>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 using std::endl;
 using std::string;
@@ -16,12 +17,22 @@ using std::runtime_error;
 
 Play_settings::Play_settings(int argc, char* argv[]){
 
-    if(argc != num_settings + 1){
+    if(argc < num_settings + 1){
         std::cout <<
-            "Usage: <mode: wsmr> <block generation: seed# or i> <lookahead> <queue size> <game length> <num threads> <e to see board log, anything else otherwise>"
+            "Usage: <mode: wsmrb> <block generation: seed# or i> <lookahead> <queue size> <game length> <num threads> <e to see board log, anything else otherwise> [key=value ...]"
             "\n"
-            "For example: ./main w 0 7 6 100 20 e"
-            << endl;;
+            "Optional: deadline_ms=<ms per move, 0 for none> node_budget=<states per move, 0 for none>"
+            " engine=<dfs or beam> beam_width=<states kept per ply by beam>"
+            " chance_budget=<placements per move scoring a ply past the queue, 0 for off>"
+            " rollouts=<rollouts per candidate leaf, 0 for off> rollout_length=<placements per rollout>"
+            " evaluator=<hand or learned> weights=<learned evaluator weights file>"
+            " policy=<standard, tall_stack or low_stack> pruning=<all, none, or rules to keep: height,holes>"
+            " games=<batch games> game_threads=<batch games at once, 0 for one per core> summary=<batch JSON file>"
+            "\n"
+            "For example: ./main w 0 7 6 100 20 e deadline_ms=10"
+            "\n"
+            "Or, for 1000 headless games on every core: ./main b 0 5 4 200 1 n games=1000"
+            << endl;
 
         exit(1);
     }
@@ -31,7 +42,8 @@ Play_settings::Play_settings(int argc, char* argv[]){
         block_generator = new Stdin_block_generator();
     }
     else{
-        block_generator = new Random_block_generator(atoi(argv[2]));
+        seed = static_cast<unsigned int>(atoi(argv[2]));
+        block_generator = new Random_block_generator(seed);
     }
 
     lookahead_placements = atoi(argv[3]);
@@ -40,17 +52,148 @@ Play_settings::Play_settings(int argc, char* argv[]){
     num_threads = atoi(argv[6]);
     board_log = string(argv[7]) == "e";
 
-    if(lookahead_placements > queue_size + 1 ){
+    for(int arg_x = num_settings + 1; arg_x < argc; ++arg_x){
+        parse_optional_setting(argv[arg_x]);
+    }
+
+    // The chance layer sees one block past the queue.
+    if(lookahead_placements > queue_size + 1 + (chance_budget > 0)){
         throw runtime_error{"With this queue size, Jeff cannot see that far into the future"};
     }
     if(lookahead_placements < 1){
         throw runtime_error{"Jeff needs something to work with here!"};
     }
+    if(deadline_ms < 0 || node_budget < 0 || chance_budget < 0 || rollouts < 0){
+        throw runtime_error{"Search limits cannot be negative"};
+    }
+    if(beam_width < 1){
+        throw runtime_error{"The beam must keep at least one state"};
+    }
+    if(engine == Search_engine::beam && node_budget){
+        throw runtime_error{"The beam engine has no node budget. Its work is set by beam_width"};
+    }
+    if(engine == Search_engine::beam && chance_budget){
+        throw runtime_error{"The beam engine has no chance layer"};
+    }
+    if(engine == Search_engine::beam && rollouts){
+        throw runtime_error{"The beam engine has no rollouts"};
+    }
+    if(rollouts && lookahead_placements < queue_size + 1){
+        throw runtime_error{"Rollouts start past the queue, so the lookahead must reach its end"};
+    }
+    if(rollout_length < 1){
+        throw runtime_error{"Rollouts must place at least one block"};
+    }
+    if(is_batch() && *argv[2] == 'i'){
+        throw runtime_error{"Batch games are seeded, so cannot read blocks from input"};
+    }
+    if(games < 1 || game_threads < 0){
+        throw runtime_error{"A batch needs at least one game, and cannot use negative threads"};
+    }
+
+}
+
+void Play_settings::parse_optional_setting(const string& setting){
+
+    const size_t equals_x = setting.find('=');
+    if(equals_x == string::npos){
+        throw runtime_error{"Optional settings look like key=value, not " + setting};
+    }
+    const string key = setting.substr(0, equals_x);
+    const string value = setting.substr(equals_x + 1);
 
+    if(key == "deadline_ms"){
+        deadline_ms = stoi(value);
+    }
+    else if(key == "node_budget"){
+        node_budget = stol(value);
+    }
+    else if(key == "engine"){
+        if(value == "dfs"){
+            engine = Search_engine::dfs;
+        }
+        else if(value == "beam"){
+            engine = Search_engine::beam;
+        }
+        else{
+            throw runtime_error{"Unknown engine: " + value};
+        }
+    }
+    else if(key == "beam_width"){
+        beam_width = stoi(value);
+    }
+    else if(key == "chance_budget"){
+        chance_budget = stol(value);
+    }
+    else if(key == "rollouts"){
+        rollouts = stoi(value);
+    }
+    else if(key == "rollout_length"){
+        rollout_length = stoi(value);
+    }
+    else if(key == "evaluator"){
+        if(value == "hand"){
+            evaluator = Evaluator::hand;
+        }
+        else if(value == "learned"){
+            evaluator = Evaluator::learned;
+        }
+        else{
+            throw runtime_error{"Unknown evaluator: " + value};
+        }
+    }
+    else if(key == "weights"){
+        weights = value;
+    }
+    else if(key == "pruning"){
+        const bool all = value == "all";
+        pruning_rules = Pruning_rules{all, all};
+        if(value != "all" && value != "none"){
+            std::istringstream rules{value};
+            string rule;
+            while(getline(rules, rule, ',')){
+                if(rule == "height"){
+                    pruning_rules.height_increase = true;
+                }
+                else if(rule == "holes"){
+                    pruning_rules.holes_above_ancestor = true;
+                }
+                else{
+                    throw runtime_error{"Unknown pruning rule: " + rule};
+                }
+            }
+        }
+    }
+    else if(key == "games"){
+        games = stoi(value);
+    }
+    else if(key == "game_threads"){
+        game_threads = stoi(value);
+    }
+    else if(key == "summary"){
+        summary = value;
+    }
+    else if(key == "policy"){
+        if(value == "standard"){
+            policy = Policy_id::standard;
+        }
+        else if(value == "tall_stack"){
+            policy = Policy_id::tall_stack;
+        }
+        else if(value == "low_stack"){
+            policy = Policy_id::low_stack;
+        }
+        else{
+            throw runtime_error{"Unknown policy: " + value};
+        }
+    }
+    else{
+        throw runtime_error{"Unknown setting: " + key};
+    }
 }
 
 void Play_settings::wait_for_controller_connection_if_necessary(){
-    if(is_watching() || mode == 's'){
+    if(is_watching() || is_batch() || mode == 's'){
         return;
     }
     if(mode != 'm' && mode != 'r'){
@@ -1,8 +1,27 @@
 #ifndef PLAY_SETTINGS_H
 #define PLAY_SETTINGS_H
 
+#include <string>
+
+#include "search_policy.h"
+#include "board.h"
+
 class Block_generator;
 
+enum class Evaluator {
+    // The hand-written utility in Board.
+    hand,
+    // A Learned_evaluator, with weights from a file.
+    learned
+};
+
+enum class Search_engine {
+    // Exhaustive depth first search. Finds the best leaf.
+    dfs,
+    // Keeps only the best states of each ply. Bounded work at any depth, but may miss the best leaf.
+    beam
+};
+
 // ALL gathered from command line.
 struct Play_settings {
 
@@ -11,6 +30,7 @@ struct Play_settings {
     s: 99 skip
     m: 99 from menu
     r: 99 from restart
+    b: batch of seeded games, played headless. See games, game_threads and summary below.
     */
     char mode;
 
@@ -19,6 +39,9 @@ struct Play_settings {
     */
     Block_generator* block_generator;
 
+    // The seed block_generator was made with, if any. Batch games are dealt seed, seed + 1, ...
+    unsigned int seed = 0;
+
     // [1, 7]
     int lookahead_placements;
 
@@ -31,7 +54,55 @@ struct Play_settings {
 
     bool board_log;
 
+    // === Optional. Given as key=value after the required settings. ===
+
+    // deadline_ms: Wall clock limit on searching for one move. 0 for no limit.
+    int deadline_ms = 0;
+
+    // node_budget: Limit on states considered while searching for one move. 0 for no limit.
+    long node_budget = 0;
+
+    // engine: dfs or beam.
+    Search_engine engine = Search_engine::dfs;
+
+    // beam_width: States kept per ply by the beam engine.
+    int beam_width = 64;
+
+    // chance_budget: Placements tried per move scoring one more ply past the queue by expectation,
+    // over the blocks the bag may deal next. Lets lookahead reach queue size + 2. 0 for off.
+    long chance_budget = 0;
+
+    // rollouts: Greedy games played on from each of the best few leaves, to choose between them
+    // by how often they survive and tetris. 0 for off.
+    int rollouts = 0;
+
+    // rollout_length: Placements per rollout.
+    int rollout_length = 20;
+
+    // evaluator: hand or learned.
+    Evaluator evaluator = Evaluator::hand;
+
+    // weights: File the learned evaluator reads its weights from.
+    std::string weights = "evaluator_weights.txt";
+
+    // policy: standard, tall_stack or low_stack. See search_policy.h.
+    Policy_id policy = Policy_id::standard;
+
+    // pruning: all, none, or a comma separated list of the is_promising() rules to keep: height, holes.
+    // See Pruning_rules.
+    Pruning_rules pruning_rules;
+
+    // games: Games played in batch mode.
+    int games = 100;
+
+    // game_threads: Batch games played at once, each searching with num_threads workers. 0 for one per core.
+    int game_threads = 0;
+
+    // summary: File batch mode writes its results to, as JSON.
+    std::string summary = "self_play_summary.json";
+
     // NOTE: IMPORTANT
+    // Number of required settings.
     inline static constexpr int num_settings = 7;
 
     Play_settings(int argc, char* argv[]);
@@ -40,7 +111,19 @@ struct Play_settings {
         return mode == 'w';
     }
 
+    bool is_batch() const {
+        return mode == 'b';
+    }
+
     void wait_for_controller_connection_if_necessary();
+
+    bool has_search_limit() const {
+        return deadline_ms > 0 || node_budget > 0;
+    }
+
+private:
+
+    void parse_optional_setting(const std::string& setting);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,311 @@
+#include "player.h"
+#include "utility.h"
+
+#include <iostream>
+#include <algorithm>
+#include <utility>
+
+using std::min;
+using std::move;
+using std::optional;
+using std::vector;
+using std::ostream;
+using std::chrono::steady_clock;
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+using std::chrono::duration_cast;
+
+using Tetris_queue_t = State::Tetris_queue_t;
+
+// Rollouts choose between the best leaves below this many root placements.
+static const int c_max_rollout_leaves = 4;
+
+Player::Player(const Play_settings& settings, const Board_settings& board_settings)
+    : engine{settings.num_threads, board_settings} {
+
+    if(settings.engine == Search_engine::beam){
+        beam_search.emplace(engine, settings.beam_width);
+    }
+    if(settings.rollouts){
+        rollout_evaluator.emplace(engine, settings.rollouts, settings.rollout_length);
+    }
+}
+
+optional<Search_result> get_best_move(
+        Player& player,
+        Board& board,
+        const Block& presented,
+        const Tetris_queue_t& queue,
+        std::uint8_t possible_next_blocks,
+        const Play_settings& settings,
+        const vector<Placement>& expected_line){
+
+    const auto start_time = steady_clock::now();
+
+    Engine& engine = player.engine;
+    board.use_settings(engine.get_board_settings());
+    board.load_ancestral_data_with_current_data();
+
+    engine.assert_all_free();
+
+    const optional<Position_result> known = move(player.next_position_result);
+    player.next_position_result.reset();
+    if(known && known->board_key == board.get_search_key() && known->presented_index == presented.index
+            && known->queue == queue && known->possible_next_blocks == possible_next_blocks
+            && known->lookahead_placements == settings.lookahead_placements
+            && known->chance_budget == settings.chance_budget){
+        Search_result result = known->result;
+        result.time_used = duration_cast<microseconds>(steady_clock::now() - start_time);
+        return result;
+    }
+
+    optional<steady_clock::time_point> deadline;
+    if(settings.deadline_ms){
+        deadline = start_time + milliseconds{settings.deadline_ms};
+    }
+
+    if(settings.engine == Search_engine::beam){
+        const optional<Beam_search::Result> beam_result = player.beam_search->search(
+            State::generate_root_state(board, presented, queue, settings.lookahead_placements), deadline);
+        if(!beam_result){
+            return {};
+        }
+        const Beam_search::Result& result = *beam_result;
+        return Search_result{
+            result.placement,
+            result.depth_reached,
+            result.states_considered,
+            0,
+            result.counters,
+            0,
+            0,
+            0,
+            result.predicted_next_placement ? vector<Placement>{*result.predicted_next_placement} : vector<Placement>{},
+            0,
+            0,
+            0,
+            0,
+            microseconds{0},
+            duration_cast<microseconds>(steady_clock::now() - start_time),
+            false
+        };
+    }
+
+    // Every block the queue shows can be placed by this depth. Deeper needs the chance layer.
+    const int queue_depth = static_cast<int>(queue.size()) + 1;
+    const int last_static_depth = min(settings.lookahead_placements, queue_depth);
+
+    // Iterative deepening. Without limits, every search but the last would be thrown away,
+    // except that a search with the chance layer may run out of chance budget, so the one before it is kept.
+    const int first_depth = settings.has_search_limit() ? 1 : last_static_depth;
+
+    optional<Placement> best_placement;
+    // Each search follows the best line of the one before first.
+    vector<Placement> line = expected_line;
+    int depth_reached = 0;
+    long states_considered = 0;
+    long states_pruned = 0;
+    Search_counters counters;
+    int placement_rank = 0;
+    int num_root_placements = 0;
+    long states_before_best_found = 0;
+    long chance_placements_tried = 0;
+    // Best leaves below different root placements, from the deepest search that reached past the queue,
+    // that the utility key cannot tell apart in its primary word. Rollouts choose between them.
+    vector<Scored_state> rollout_leaves;
+
+    for(int depth = first_depth; depth <= settings.lookahead_placements; ++depth){
+
+        // The first search always finishes, so there is a move to make unless every placement tops out.
+        Search_limits limits;
+        if(best_placement){
+            limits.deadline = deadline;
+            if(settings.node_budget){
+                const long budget_left = settings.node_budget - states_considered;
+                if(budget_left <= 0){
+                    break;
+                }
+                limits.node_budget = budget_left;
+            }
+        }
+
+        State root_state = State::generate_root_state(board, presented, queue, depth);
+
+        optional<Chance_layer> chance_layer;
+        if(depth > last_static_depth){
+            chance_layer = Chance_layer{possible_next_blocks, settings.chance_budget};
+        }
+
+        // Rollouts start past the queue, so only leaves there are worth keeping for them.
+        const bool keep_rollout_leaves = settings.rollouts && depth >= queue_depth;
+
+        const bool completed = engine.distribute_new_work_and_wait_till_all_free(
+            move(root_state), limits, line, chance_layer, keep_rollout_leaves);
+        states_considered += engine.get_num_states_considered();
+        states_pruned += engine.get_num_states_pruned();
+        counters += engine.get_search_counters();
+        // A search can complete without scoring a leaf, if every placement tops out.
+        const optional<State>& best_state = engine.get_best_reachable_state();
+        if(!completed || !best_state){
+            break;
+        }
+
+        best_placement = best_state->get_placement_taken_from_root();
+        line = {*best_placement};
+        if(best_state->get_second_placement_taken_from_root()){
+            line.push_back(*best_state->get_second_placement_taken_from_root());
+        }
+        depth_reached = depth;
+        placement_rank = *engine.get_best_root_placement_rank();
+        num_root_placements = engine.get_num_root_placements();
+        states_before_best_found = *engine.get_num_states_before_best_found();
+        chance_placements_tried = engine.get_num_chance_placements_tried();
+        if(keep_rollout_leaves){
+            rollout_leaves = engine.get_best_leaf_per_root_placement(c_max_rollout_leaves);
+            // Greedy rollouts are too short sighted to overrule the primary word, only to refine it.
+            const std::uint64_t best_primary = rollout_leaves.front().key.primary;
+            rollout_leaves.erase(std::find_if(rollout_leaves.begin(), rollout_leaves.end(),
+                [best_primary](const Scored_state& leaf){
+                    return leaf.key.primary != best_primary;
+                }), rollout_leaves.end());
+        }
+
+        // engine.print_workers_states();
+
+        // cout << "This is the worst board I can imagine!\n";
+        // cout << best_state << "\n";
+
+        if(deadline && steady_clock::now() >= *deadline){
+            break;
+        }
+    }
+
+    if(!best_placement){
+        return {};
+    }
+
+    int rollout_choice_rank = 0;
+    long rollouts_played = 0;
+    microseconds rollout_time{0};
+    if(rollout_leaves.size() > 1){
+        const auto rollout_start_time = steady_clock::now();
+
+        Rollout_evaluator& rollout_evaluator = *player.rollout_evaluator;
+        // Same position, same blocks dealt.
+        const std::uint64_t seed = hash_combine(board.get_search_key(), presented.index);
+        vector<Board> leaf_boards;
+        for(const auto& leaf : rollout_leaves){
+            leaf_boards.push_back(leaf.state.get_board());
+        }
+        const vector<Rollout_evaluator::Score> scores =
+            rollout_evaluator.evaluate(leaf_boards, possible_next_blocks, seed);
+
+        // Only a leaf the rollouts like strictly better replaces the search's choice.
+        for(size_t leaf_x = 0; leaf_x < rollout_leaves.size(); ++leaf_x){
+            if(rollout_leaves[leaf_x].state.get_placement_taken_from_root() == *best_placement){
+                rollout_choice_rank = static_cast<int>(leaf_x);
+            }
+        }
+        for(size_t leaf_x = 0; leaf_x < rollout_leaves.size(); ++leaf_x){
+            if(scores[leaf_x] > scores[rollout_choice_rank]){
+                rollout_choice_rank = static_cast<int>(leaf_x);
+            }
+        }
+
+        const State& chosen_leaf = rollout_leaves[rollout_choice_rank].state;
+        if(!(chosen_leaf.get_placement_taken_from_root() == *best_placement)){
+            best_placement = chosen_leaf.get_placement_taken_from_root();
+            line = {*best_placement};
+            if(chosen_leaf.get_second_placement_taken_from_root()){
+                line.push_back(*chosen_leaf.get_second_placement_taken_from_root());
+            }
+        }
+        rollouts_played = rollout_evaluator.take_num_rollouts_played();
+        rollout_time = duration_cast<microseconds>(steady_clock::now() - rollout_start_time);
+    }
+
+    // The best leaf is below the swap, so its line from there is what searching the next position would find,
+    // up to ties, if this search looked all the way. Not if rollouts chose, since they judge a position's leaves
+    // together. The result has no line after its placement, so the move after it searches unseeded.
+    const bool swaps_with_held_block = best_placement->get_is_hold() && board.is_holding_some_block();
+    if(swaps_with_held_block && line.size() > 1 && depth_reached == settings.lookahead_placements
+            && !settings.rollouts){
+        Board next_board = board;
+        next_board.swap_block(presented);
+        player.next_position_result = Position_result{
+            next_board.get_search_key(),
+            board.get_held_block()->index,
+            queue,
+            possible_next_blocks,
+            settings.lookahead_placements,
+            settings.chance_budget,
+            Search_result{
+                line[1],
+                depth_reached,
+                0,
+                0,
+                {},
+                0,
+                0,
+                0,
+                {},
+                0,
+                0,
+                0,
+                0,
+                microseconds{0},
+                microseconds{0},
+                true
+            }
+        };
+    }
+
+    return Search_result{
+        *best_placement,
+        depth_reached,
+        states_considered,
+        states_pruned,
+        counters,
+        placement_rank,
+        num_root_placements,
+        states_before_best_found,
+        vector<Placement>(line.begin() + 1, line.end()),
+        chance_placements_tried,
+        rollout_choice_rank,
+        rollouts_played ? static_cast<int>(rollout_leaves.size()) : 0,
+        rollouts_played,
+        rollout_time,
+        duration_cast<microseconds>(steady_clock::now() - start_time),
+        false
+    };
+}
+
+double get_rollouts_per_second(long rollouts_played, microseconds time){
+    return time.count() ? rollouts_played * 1e6 / time.count() : 0;
+}
+
+ostream& operator<<(ostream& os, const Search_result& result){
+    if(result.reused_previous_search){
+        os << "Reused the previous move's search, " << result.depth_reached << " deep\n";
+        return os;
+    }
+    os << "Searched " << result.depth_reached << " deep, "
+        << result.states_considered << " states (" << result.states_pruned << " pruned) in "
+        << result.time_used.count() / 1000.0 << " ms\n";
+    if(result.counters.num_expanded){
+        os << result.counters << "\n";
+    }
+    if(result.num_root_placements){
+        os << "Move ordering: chose root placement " << result.placement_rank + 1 << " of " << result.num_root_placements
+            << ", best leaf found after " << result.states_before_best_found << " states\n";
+    }
+    if(result.chance_placements_tried){
+        os << "Chance layer: " << result.chance_placements_tried << " placements tried past the queue\n";
+    }
+    if(result.num_rollout_leaves){
+        os << "Rollouts: chose leaf " << result.rollout_choice_rank + 1 << " of " << result.num_rollout_leaves
+            << " after " << result.rollouts_played << " rollouts in " << result.rollout_time.count() / 1000.0 << " ms ("
+            << get_rollouts_per_second(result.rollouts_played, result.rollout_time) << " per second)\n";
+    }
+    return os;
+}
@@ -0,0 +1,95 @@
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include "board.h"
+#include "block.h"
+#include "state.h"
+#include "engine.h"
+#include "play_settings.h"
+#include "beam_search.h"
+#include "rollout.h"
+
+#include <vector>
+#include <optional>
+#include <chrono>
+#include <iosfwd>
+#include <cstdint>
+
+// What the search decided, and how hard it looked.
+struct Search_result {
+    Placement placement;
+    // Deepest search that completed, in placements.
+    int depth_reached;
+    long states_considered;
+    // Dropped by branch and bound. Never changes the placement.
+    long states_pruned;
+    // Summed over every search made choosing placement.
+    Search_counters counters;
+    // How well move ordering did in the deepest search that completed. Not measured if num_root_placements is 0.
+    // Where placement was in the order root placements were tried, of how many. 0 is first.
+    int placement_rank;
+    int num_root_placements;
+    long states_before_best_found;
+    // What the search expects to play after placement, if things go as it predicts.
+    std::vector<Placement> expected_line_after;
+    // Placements tried scoring leaves past the queue, in the deepest search that completed.
+    long chance_placements_tried;
+    // Rollouts played to choose between the best leaves, if any. Not measured if num_rollout_leaves is 0.
+    // Where the leaf they chose was among the leaves, best by utility key first. 0 is first.
+    int rollout_choice_rank;
+    int num_rollout_leaves;
+    long rollouts_played;
+    std::chrono::microseconds rollout_time;
+    std::chrono::microseconds time_used;
+    // Taken from the previous move's search, which had already searched this position. See Player.
+    bool reused_previous_search;
+};
+
+std::ostream& operator<<(std::ostream& os, const Search_result& result);
+double get_rollouts_per_second(long rollouts_played, std::chrono::microseconds time);
+
+// A search result, and the position it is the result for.
+struct Position_result {
+    // Taken once ancestral data is loaded, so it covers everything below the board that is searched.
+    std::uint64_t board_key;
+    int presented_index;
+    State::Tetris_queue_t queue;
+    std::uint8_t possible_next_blocks;
+    int lookahead_placements;
+    long chance_budget;
+    Search_result result;
+};
+
+// Everything one game searches with. Players share nothing, so games with a player each can be played at once.
+struct Player {
+    // Boards are scored and pruned by board_settings.
+    Player(const Play_settings& settings, const Board_settings& board_settings);
+
+    Engine engine;
+    // Only made if the settings use them.
+    std::optional<Beam_search> beam_search;
+    std::optional<Rollout_evaluator> rollout_evaluator;
+    // Swapping with the held block deals nothing, so the position it leads to is one the search choosing it
+    // searched below that root placement, to the same horizon. If that search completed and found its best leaf
+    // there, the best line from that position is already known. Kept for the next move only.
+    // Only the positions a swap leads to are known ahead. After anything else, a block is dealt,
+    // the horizon moves on, and ancestral data is taken from a new board, so no earlier result carries over.
+    std::optional<Position_result> next_position_result;
+};
+
+// Board uses the player's engine's board settings from now on, so the moves made on it are judged as searched.
+// Possible_next_blocks are the blocks that may come after the queue. See Bag_tracker.
+// Expected_line is what the previous move's search expected to play from here, if anything.
+// It is searched first, so the search starts with a good leaf to prune against.
+// If the player already knows the result for this position, it is returned without searching.
+// Empty iff there is no move to make, because every placement tops out.
+std::optional<Search_result> get_best_move(
+        Player& player,
+        Board& board,
+        const Block& presented,
+        const State::Tetris_queue_t& queue,
+        std::uint8_t possible_next_blocks,
+        const Play_settings& settings,
+        const std::vector<Placement>& expected_line);
+
+#endif
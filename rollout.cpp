@@ -0,0 +1,174 @@
+#include "rollout.h"
+#include "engine.h"
+#include "block.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <optional>
+#include <random>
+#include <utility>
+#include <cassert>
+
+using std::array;
+using std::optional;
+using std::vector;
+using std::uint8_t;
+using std::uint16_t;
+using std::uint64_t;
+
+// Deals the rest of the current bag, then whole bags, each shuffled. Never allocates.
+class Bag_stream {
+
+public:
+
+    Bag_stream(uint8_t rest_of_bag, uint64_t seed)
+        : generator{static_cast<std::default_random_engine::result_type>(seed)} {
+        refill(rest_of_bag);
+    }
+
+    const Block& next(){
+        if(block_x == num_blocks){
+            refill(Bag_tracker::c_full_bag);
+        }
+        return *bag[block_x++];
+    }
+
+private:
+
+    void refill(uint8_t blocks){
+        num_blocks = 0;
+        block_x = 0;
+        for(const Block* b : Block::all_blocks){
+            if(blocks & (1u << b->index)){
+                bag[num_blocks++] = b;
+            }
+        }
+        std::shuffle(bag.begin(), bag.begin() + num_blocks, generator);
+    }
+
+    array<const Block*, Block::c_num_blocks> bag;
+    int num_blocks = 0;
+    int block_x = 0;
+    std::default_random_engine generator;
+};
+
+bool place_greedily(Board& board, const Block& b){
+
+    const Block* const held = board.get_held_block();
+    const array<const Block*, 2> choices{&b, held && board.can_swap_block(b) ? held : nullptr};
+
+    optional<Utility_key> best_key;
+    const Block* best_block = nullptr;
+    Placement best_placement{0, 0, false};
+
+    Board::Undo_record undo_record;
+    for(const Block* choice : choices){
+        if(!choice){
+            continue;
+        }
+        for(int rot_x = 0; rot_x < choice->num_rotations; ++rot_x){
+            for(uint16_t cols_left = board.scan_rotation(*choice, rot_x).promising_cols; cols_left;
+                    cols_left &= cols_left - 1){
+                const Placement placement{rot_x, __builtin_ctz(cols_left), false};
+                if(board.place_block(*choice, placement, undo_record)){
+                    const Utility_key key = board.get_utility_key();
+                    if(!best_key || key > *best_key){
+                        best_key = key;
+                        best_block = choice;
+                        best_placement = placement;
+                    }
+                }
+                board.undo(undo_record);
+            }
+        }
+    }
+    if(!best_key){
+        return false;
+    }
+
+    if(best_block != &b){
+        board.swap_block(b);
+    }
+    board.place_block(*best_block, best_placement);
+    return true;
+}
+
+bool Rollout_evaluator::Score::operator>(const Score& other) const {
+    return expectation.get_key() > other.expectation.get_key();
+}
+
+Rollout_evaluator::Score& Rollout_evaluator::Score::operator+=(const Score& other){
+    expectation += other.expectation;
+    return *this;
+}
+
+Rollout_evaluator::Rollout_evaluator(Engine& _engine, int _num_rollouts, int _rollout_length)
+    : engine{_engine}, num_rollouts{_num_rollouts}, rollout_length{_rollout_length} {
+
+    assert(num_rollouts > 0);
+    assert(rollout_length > 0);
+}
+
+vector<Rollout_evaluator::Score> Rollout_evaluator::evaluate(const vector<Board>& boards, uint8_t possible_next_blocks,
+        uint64_t seed){
+
+    worker_scores.resize(engine.get_num_workers());
+    for(auto& scores : worker_scores){
+        scores.assign(boards.size(), Score{engine.get_board_settings()});
+    }
+
+    const std::function<void(int)> rollout_task = [this, &boards, possible_next_blocks, seed](int worker_x){
+        play_rollouts(worker_x, boards, possible_next_blocks, seed);
+    };
+    engine.run_on_every_worker(rollout_task);
+
+    vector<Score> scores(boards.size(), Score{engine.get_board_settings()});
+    for(const auto& worker_score : worker_scores){
+        for(size_t board_x = 0; board_x < boards.size(); ++board_x){
+            scores[board_x] += worker_score[board_x];
+        }
+    }
+    num_rollouts_played += static_cast<long>(boards.size()) * num_rollouts;
+    return scores;
+}
+
+long Rollout_evaluator::take_num_rollouts_played(){
+    return std::exchange(num_rollouts_played, 0);
+}
+
+void Rollout_evaluator::play_rollouts(int worker_x, const vector<Board>& boards, uint8_t possible_next_blocks,
+        uint64_t seed){
+
+    vector<Score>& scores = worker_scores[worker_x];
+
+    // Deal every (board, rollout) pair out like cards.
+    const long num_jobs = static_cast<long>(boards.size()) * num_rollouts;
+    for(long job_x = worker_x; job_x < num_jobs; job_x += static_cast<long>(worker_scores.size())){
+        const long board_x = job_x / num_rollouts;
+        const long rollout_x = job_x % num_rollouts;
+        // Rollout rollout_x deals the same blocks from every board.
+        scores[board_x] += play_rollout(boards[board_x], possible_next_blocks, hash_combine(seed, rollout_x));
+    }
+}
+
+Rollout_evaluator::Score Rollout_evaluator::play_rollout(const Board& start_board, uint8_t possible_next_blocks,
+        uint64_t rollout_seed) const {
+
+    Board board{start_board};
+    board.use_settings(engine.get_board_settings());
+    Bag_stream blocks{possible_next_blocks, rollout_seed};
+
+    Score score{engine.get_board_settings()};
+    for(int placement_x = 0; placement_x < rollout_length; ++placement_x){
+        // As between real moves, promise is judged against the board before each placement.
+        board.load_ancestral_data_with_current_data();
+        if(!place_greedily(board, blocks.next())){
+            score.expectation.add({});
+            return score;
+        }
+    }
+    score.expectation.add(board.get_utility());
+    return score;
+}
@@ -0,0 +1,70 @@
+#ifndef ROLLOUT_H
+#define ROLLOUT_H
+
+#include "board.h"
+
+#include <vector>
+#include <cstdint>
+
+class Engine;
+
+// Place b, or the held block in its place, wherever gives the greatest utility key.
+// Returns false iff neither has a promising placement. With nothing held, never holds.
+bool place_greedily(Board& board, const Block& b);
+
+// Scores boards by playing on from each of them many times, placing every block greedily by utility key,
+// with blocks dealt the way the bag deals them. Rollouts run on an Engine's workers.
+// Every board sees the same block sequences, so differences in score are down to the boards.
+class Rollout_evaluator {
+
+public:
+
+    // How a board fared over all its rollouts.
+    struct Score {
+        explicit Score(const Board_settings& settings)
+            : expectation{settings} {
+        }
+
+        // Over the boards the rollouts ended on, topping out being worth the least of everything.
+        // Boards are ranked by this, since the key already weighs tetrises against everything else.
+        Board::Utility_expectation expectation;
+
+        // Greater expected utility key.
+        bool operator>(const Score& other) const;
+        Score& operator+=(const Score& other);
+    };
+
+    Rollout_evaluator(Engine& _engine, int _num_rollouts, int _rollout_length);
+
+    // Requires: Workers are free.
+    // Plays num_rollouts rollouts of rollout_length placements from every board, and returns each board's score.
+    // Rollouts are played with the engine's board settings, whatever the boards use.
+    // Possible_next_blocks are the blocks that may come after the boards. See Bag_tracker.
+    // The block sequences depend only on seed and possible_next_blocks.
+    std::vector<Score> evaluate(const std::vector<Board>& boards, std::uint8_t possible_next_blocks, std::uint64_t seed);
+
+    // Rollouts played since this was last called.
+    long take_num_rollouts_played();
+
+    Rollout_evaluator(const Rollout_evaluator& other) = delete;
+    Rollout_evaluator& operator=(const Rollout_evaluator& other) = delete;
+
+private:
+
+    // Plays the rollouts assigned to this worker.
+    void play_rollouts(int worker_x, const std::vector<Board>& boards, std::uint8_t possible_next_blocks,
+        std::uint64_t seed);
+
+    // Plays one rollout from board, dealing blocks from rollout_seed.
+    Score play_rollout(const Board& start_board, std::uint8_t possible_next_blocks, std::uint64_t rollout_seed) const;
+
+    Engine& engine;
+    const int num_rollouts;
+    const int rollout_length;
+
+    // Per worker, one score per board. Only touched by that worker during evaluate().
+    std::vector<std::vector<Score>> worker_scores;
+    long num_rollouts_played = 0;
+};
+
+#endif
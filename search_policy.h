@@ -0,0 +1,59 @@
+#ifndef SEARCH_POLICY_H
+#define SEARCH_POLICY_H
+
+#include <cassert>
+
+// Thresholds the hand-written utility and place_block()'s pruning are built from.
+// The search is compiled once per policy, with its thresholds as constants, so strategies can be
+// compared without editing code and without slowing the search down.
+
+// What Jeff has always played.
+struct Standard_policy {
+    // You are in tetris mode if you are here or less in height.
+    static constexpr int c_max_tetris_mode_height = 6;
+    // Boards whose highest column is this much above the second lowest are punished.
+    static constexpr int c_height_diff_punishment_thresh = 3;
+    // Placements that raise the highest column more than this above the ancestor's are not promising.
+    static constexpr int c_max_acceptable_height_increase = 3;
+    // Nor are those leaving more holes than this above the ancestor's highest column.
+    static constexpr int c_max_acceptable_holes_above_anc = 0;
+};
+
+// Stacks higher before giving up on tetrises, and prunes less.
+struct Tall_stack_policy : Standard_policy {
+    static constexpr int c_max_tetris_mode_height = 8;
+    static constexpr int c_max_acceptable_height_increase = 4;
+};
+
+// Keeps the stack low, and prunes more.
+struct Low_stack_policy : Standard_policy {
+    static constexpr int c_max_tetris_mode_height = 4;
+    static constexpr int c_max_acceptable_height_increase = 2;
+};
+
+// To register a policy, add it here, to dispatch_on_policy() and FOR_EACH_POLICY, and to Play_settings.
+enum class Policy_id {
+    standard,
+    tall_stack,
+    low_stack
+};
+
+// Calls func with the policy id names, so func is compiled for every policy and the choice is made once.
+template <typename Func>
+auto dispatch_on_policy(Policy_id id, Func&& func){
+    switch(id){
+        case Policy_id::tall_stack: return func(Tall_stack_policy{});
+        case Policy_id::low_stack: return func(Low_stack_policy{});
+        default:
+            assert(id == Policy_id::standard);
+            return func(Standard_policy{});
+    }
+}
+
+// Expands macro(Policy) for every policy, to explicitly instantiate templates defined in .cpp files.
+#define FOR_EACH_POLICY(macro) \
+    macro(Standard_policy) \
+    macro(Tall_stack_policy) \
+    macro(Low_stack_policy)
+
+#endif
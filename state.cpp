@@ -1,10 +1,15 @@
 #include "state.h"
 #include "block.h"
+#include "utility.h"
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 using std::optional;
 using std::ostream;
+using std::uint8_t;
+using std::uint16_t;
 
 // === STATE ===
 
@@ -15,11 +20,13 @@ State::State(
         bool _is_leaf,
         const Tetris_queue_t::const_iterator& _end_queue_it,
         int _placement_limit,
-        std::optional<Placement> _placement_taken_from_root)
+        std::optional<Placement> _placement_taken_from_root,
+        std::optional<Placement> _second_placement_taken_from_root)
 
     : board{_board}, presented_block{_presented_block}, next_queue_it{_next_queue_it},
     is_leaf{_is_leaf}, end_queue_it{_end_queue_it}, placement_limit{_placement_limit},
-    placement_taken_from_root{_placement_taken_from_root}, pg{_presented_block} {
+    placement_taken_from_root{_placement_taken_from_root},
+    second_placement_taken_from_root{_second_placement_taken_from_root} {
 }
 
 State State::generate_root_state(
@@ -42,15 +49,66 @@ State State::generate_root_state(
 
 }
 
-optional<State> State::generate_next_child() {
+void State::use_board_settings(const Board_settings& settings){
+    board.use_settings(settings);
+}
 
-    for(optional<Placement> placement = pg(); placement; placement = pg()){
-        optional<State> child = generate_child_from_placement(*placement);
-        if(child){
-            return child;
-        }
+std::uint64_t State::get_transposition_key() const {
+    std::uint64_t key = board.get_search_key();
+    key = hash_combine(key, presented_block->index);
+    key = hash_combine(key, end_queue_it - next_queue_it);
+    key = hash_combine(key, placement_limit);
+    return key;
+}
+
+// Bit 7 set iff there is a placement. Then bit 6 is is_hold, bits 4-5 the rotation, bits 0-3 the column.
+static uint8_t pack_placement(const optional<Placement>& placement){
+    if(!placement){
+        return 0;
     }
-    return {};
+    return 0x80 | (placement->get_is_hold() << 6) | (placement->get_rotation() << 4) | placement->get_column();
+}
+
+static optional<Placement> unpack_placement(uint8_t placement){
+    if(!(placement & 0x80)){
+        return {};
+    }
+    return Placement{(placement >> 4) & 0x3, placement & 0xF, static_cast<bool>(placement & 0x40)};
+}
+
+Compact_state State::compact(const State& root) const {
+
+    Compact_state compact_state;
+    compact_state.board = board.pack();
+    compact_state.presented_block_index = presented_block->index;
+    compact_state.next_queue_offset = next_queue_it - root.next_queue_it;
+    compact_state.remaining_depth = get_remaining_depth();
+    compact_state.is_leaf = is_leaf;
+    compact_state.placement_taken_from_root = pack_placement(placement_taken_from_root);
+    compact_state.second_placement_taken_from_root = pack_placement(second_placement_taken_from_root);
+    return compact_state;
+}
+
+State::State(const Compact_state& compact_state, const State& root)
+    : board{compact_state.board, root.board.get_settings()},
+    presented_block{Block::all_blocks[compact_state.presented_block_index]},
+    next_queue_it{root.next_queue_it + compact_state.next_queue_offset},
+    is_leaf{compact_state.is_leaf}, end_queue_it{root.end_queue_it},
+    placement_limit{board.get_num_blocks_placed() + compact_state.remaining_depth},
+    placement_taken_from_root{unpack_placement(compact_state.placement_taken_from_root)},
+    second_placement_taken_from_root{unpack_placement(compact_state.second_placement_taken_from_root)} {
+}
+
+template <class Policy>
+Utility_key State::get_utility_upper_bound(bool next_unseen_may_be_cyan) const {
+
+    // Only a Cyan can clear four rows at once. Count every one we could still place.
+    // A leaf's queue iterator may be past the end, and nothing is presented to it.
+    int num_cyans = is_leaf ? 0 : static_cast<int>(std::count(next_queue_it, end_queue_it, &Block::Cyan));
+    num_cyans += !is_leaf && presented_block == &Block::Cyan;
+    num_cyans += board.is_holding(Block::Cyan);
+    num_cyans += next_unseen_may_be_cyan;
+    return board.get_utility_upper_bound<Policy>(get_remaining_depth(), num_cyans);
 }
 
 
@@ -81,7 +139,8 @@ optional<State> State::generate_child_from_placement(Placement placement){
                 is_leaf,
                 end_queue_it,
                 placement_limit,
-                placement_taken_from_root ? placement_taken_from_root : optional<Placement>{placement}
+                placement_taken_from_root ? placement_taken_from_root : optional<Placement>{placement},
+                get_second_placement_for_child(placement)
             };
         }
     }
@@ -96,43 +155,125 @@ optional<State> State::generate_child_from_placement(Placement placement){
             is_leaf,
             end_queue_it,
             placement_limit,
-            placement_taken_from_root ? placement_taken_from_root : optional<Placement>{placement}
+            placement_taken_from_root ? placement_taken_from_root : optional<Placement>{placement},
+            get_second_placement_for_child(placement)
         };
     }
     return {};
 }
 
-// ===================   Placement Generator     ==============================
+optional<Placement> State::get_second_placement_for_child(Placement placement) const {
+    return placement_taken_from_root && !second_placement_taken_from_root
+        ? optional<Placement>{placement} : second_placement_taken_from_root;
+}
 
-// Returns all possible placements, and then an empty optional when none remain.
-State::Placement_generator::Placement_generator(const Block* _presented)
-    : presented{_presented}, rot_x{0}, col{0}, exhausted{false} {
+// Higher is tried first: keeping at most one trench, then fewest new holes, then the flattest board.
+// Stats are not computed for placements that clear rows, so they look flat, which is usually true.
+static int get_placement_priority(const Board::Rotation_scan& scan, int col){
+    const Height_stats& stats = scan.stats[col];
+    const bool clears_rows = scan.clearing_cols & (1u << col);
+    const bool keeps_trench = clears_rows || stats.num_trenches <= 1;
+    // Sum of squared heights is below 2^12.
+    return (keeps_trench << 20) - (scan.new_holes[col] << 12) - (clears_rows ? 0 : stats.sum_of_squared_heights);
 }
 
-// WE WANT COROUTINES
-// Emulates:
-// for(int rot_x = 0; rot_x < presented.maps.size(); ++rot_x){
-//     const int max_valid_col = Board::c_cols - presented.maps[rot_x].contour.size();
-//     for(int col = 0; col <= max_valid_col; ++col){
-optional<Placement> State::Placement_generator::operator()(){
+template <class Policy>
+int State::generate_ordered_placements(Placement_list_t& placements, optional<Placement> try_first) const {
 
-    if(exhausted){
-        return {};
+    // Holding is worth trying, but nothing says how good it is, so it sorts last.
+    placements[0] = {{0, 0, true}, std::numeric_limits<int>::min()};
+    int num_placements = 1;
+    for(int rot_x = 0; rot_x < presented_block->num_rotations; ++rot_x){
+        const Board::Rotation_scan scan = board.scan_rotation<Policy>(*presented_block, rot_x);
+        for(uint16_t cols_left = scan.promising_cols; cols_left; cols_left &= cols_left - 1){
+            const int col = __builtin_ctz(cols_left);
+            placements[num_placements++] = {{rot_x, col, false}, get_placement_priority(scan, col)};
+        }
+    }
+
+    if(try_first){
+        for(int placement_x = 0; placement_x < num_placements; ++placement_x){
+            if(placements[placement_x].placement == *try_first){
+                placements[placement_x].priority = std::numeric_limits<int>::max();
+            }
+        }
     }
 
-    for(; rot_x < presented->maps.size(); ++rot_x){
-        const int max_valid_col = Board::c_cols - presented->maps[rot_x].contour.size();
-        // Only time rot_x is incremented is when this is false.
-        while(col <= max_valid_col){
-            // Increment col every time. Do so before control leaves.
-            return {{rot_x, col++, false}};
+    // Insertion sort. There are few, and ties keep generation order.
+    for(int placement_x = 1; placement_x < num_placements; ++placement_x){
+        const Ranked_placement ranked = placements[placement_x];
+        int insert_x = placement_x;
+        for(; insert_x > 0 && placements[insert_x - 1].priority < ranked.priority; --insert_x){
+            placements[insert_x] = placements[insert_x - 1];
         }
-        col = 0;
+        placements[insert_x] = ranked;
     }
+    return num_placements;
+}
 
-    exhausted = true;
-    // Returning the hold placement. 0's are never read.
-    return {{0, 0, true}};
+int State::generate_ordered_placements(Placement_list_t& placements, optional<Placement> try_first) const {
+    return dispatch_on_policy(board.get_settings().policy, [&](auto policy){
+        return generate_ordered_placements<decltype(policy)>(placements, try_first);
+    });
+}
+
+// Mirrors generate_child_from_placement().
+template <class Policy>
+bool State::make_child(Placement placement, Undo_record& undo_record){
+
+    save_for_undo(undo_record);
+
+    if(!placement.get_is_hold()){
+
+        if(!board.place_block<Policy>(*presented_block, placement, undo_record.board)){
+            board.undo(undo_record.board);
+            return false;
+        }
+        is_leaf = (board.get_num_blocks_placed() == placement_limit) || (next_queue_it == end_queue_it);
+        presented_block = is_leaf ? &Block::Cyan : *next_queue_it;
+        ++next_queue_it;
+    }
+    else if(board.can_swap_block(*presented_block)){
+
+        is_leaf = next_queue_it == end_queue_it;
+        const Block* was_held = board.swap_block(*presented_block, undo_record.board);
+        presented_block = is_leaf ? &Block::Cyan : (was_held ? was_held : *next_queue_it);
+        if(!was_held){
+            ++next_queue_it;
+        }
+    }
+    else{
+        return false;
+    }
+
+    second_placement_taken_from_root = get_second_placement_for_child(placement);
+    if(!placement_taken_from_root){
+        placement_taken_from_root = placement;
+    }
+    return true;
+}
+
+bool State::make_child(Placement placement, Undo_record& undo_record){
+    return dispatch_on_policy(board.get_settings().policy, [&](auto policy){
+        return make_child<decltype(policy)>(placement, undo_record);
+    });
+}
+
+void State::unmake_child(const Undo_record& undo_record){
+    board.undo(undo_record.board);
+    presented_block = undo_record.presented_block;
+    next_queue_it = undo_record.next_queue_it;
+    is_leaf = undo_record.is_leaf;
+    placement_taken_from_root = undo_record.placement_taken_from_root;
+    second_placement_taken_from_root = undo_record.second_placement_taken_from_root;
+}
+
+void State::save_for_undo(Undo_record& undo_record) const {
+    undo_record.presented_block = presented_block;
+    undo_record.next_queue_it = next_queue_it;
+    undo_record.is_leaf = is_leaf;
+    undo_record.placement_taken_from_root = placement_taken_from_root;
+    undo_record.second_placement_taken_from_root = second_placement_taken_from_root;
 }
 
 ostream& operator<<(ostream& os, const State& state){
@@ -140,4 +281,13 @@ ostream& operator<<(ostream& os, const State& state){
     os << state.board << "\n";
 
     return os;
-}
\ No newline at end of file
+}
+
+// The search's entry points, for every policy.
+#define INSTANTIATE_STATE_FOR_POLICY(Policy) \
+    template Utility_key State::get_utility_upper_bound<Policy>(bool next_unseen_may_be_cyan) const; \
+    template int State::generate_ordered_placements<Policy>(Placement_list_t& placements, \
+        optional<Placement> try_first) const; \
+    template bool State::make_child<Policy>(Placement placement, Undo_record& undo_record);
+FOR_EACH_POLICY(INSTANTIATE_STATE_FOR_POLICY)
+#undef INSTANTIATE_STATE_FOR_POLICY
@@ -7,6 +7,28 @@
 #include <deque>
 #include <optional>
 #include <iosfwd>
+#include <cstdint>
+#include <array>
+
+class State;
+
+// A State squeezed into one cache line, for storing states waiting to be searched.
+// Queue positions are relative to the search's root state.
+class alignas(64) Compact_state {
+
+    friend class State;
+
+    Board::Packed board;
+    std::uint8_t presented_block_index;
+    std::uint8_t next_queue_offset;
+    // placement_limit - board.get_num_blocks_placed().
+    std::uint8_t remaining_depth;
+    bool is_leaf;
+    // Bit 7 set iff there is one. Then bit 6 is is_hold, bits 4-5 the rotation, bits 0-3 the column.
+    std::uint8_t placement_taken_from_root;
+    // Same encoding.
+    std::uint8_t second_placement_taken_from_root;
+};
 
 
 // In addition to the board, has the block queue iterators, presented block, and house keeping for search logistics.
@@ -25,7 +47,8 @@ public:
         bool _is_leaf,
         const Tetris_queue_t::const_iterator& _end_queue_it,
         int _placement_limit,
-        std::optional<Placement> _placement_taken_from_root
+        std::optional<Placement> _placement_taken_from_root,
+        std::optional<Placement> _second_placement_taken_from_root = {}
     );
 
     static State generate_root_state(
@@ -43,15 +66,77 @@ public:
         return board;
     }
 
+    // Meaningless if this is a leaf.
+    const Block& get_presented_block() const {
+        return *presented_block;
+    }
+
     Placement get_placement_taken_from_root() const {
         assert(placement_taken_from_root);
         return *placement_taken_from_root;
     }
 
-    // Generate the next child. Returns empty optional when there are no more children.
-    std::optional<State> generate_next_child();
+    // The placement taken from the root's child on the way here. Empty if this is not a grandchild or deeper.
+    std::optional<Placement> get_second_placement_taken_from_root() const {
+        return second_placement_taken_from_root;
+    }
+
+    // Every state made from this one from now on, compact states included, uses settings. See Board::use_settings().
+    void use_board_settings(const Board_settings& settings);
+
+    // Equal for states whose subtrees are identical, regardless of how they were reached.
+    std::uint64_t get_transposition_key() const;
+
+    // Placements left before the search horizon.
+    int get_remaining_depth() const {
+        return placement_limit - board.get_num_blocks_placed();
+    }
+
+    // No leaf below this state has a greater utility key.
+    // If placements past the queue are searched, say whether the first of them may be Cyan.
+    template <class Policy>
+    Utility_key get_utility_upper_bound(bool next_unseen_may_be_cyan = false) const;
+
+    // === Make/unmake. Walks the tree on one state instead of copying a board per child. ===
+
+    // Most placements a state can have: every rotation at every column, and a hold.
+    static constexpr int c_max_placements = 4 * Board::c_cols + 1;
+
+    struct Undo_record;
+
+    // A placement, and how good it looks before it is tried. Greater priority is tried first.
+    struct Ranked_placement {
+        Placement placement{0, 0, false};
+        int priority = 0;
+    };
+    using Placement_list_t = std::array<Ranked_placement, c_max_placements>;
+
+    // Fills placements with every drop Board::scan_rotation() does not rule out, and the hold, best looking first,
+    // and returns how many there are. Try_first, if given and among them, comes first.
+    // Cheap static ordering, so good leaves are found early and bound more of the search.
+    // Templated on a Policy like Board. The untemplated overloads use the board's policy.
+    template <class Policy>
+    int generate_ordered_placements(Placement_list_t& placements, std::optional<Placement> try_first = {}) const;
+    int generate_ordered_placements(Placement_list_t& placements, std::optional<Placement> try_first = {}) const;
+
+    // Turn this state into its child by placement, and return true.
+    // Returns false, leaving this unchanged, iff the child is not promising, or the hold cannot be made.
+    template <class Policy>
+    bool make_child(Placement placement, Undo_record& undo_record);
+    bool make_child(Placement placement, Undo_record& undo_record);
+
+    // Requires: undo_record was filled by the latest make_child() not yet unmade.
+    void unmake_child(const Undo_record& undo_record);
+
+    // Given the current state, attempt to generate a new state with a placement.
+    // Empty optional iff make_child() would return false.
+    std::optional<State> generate_child_from_placement(Placement placement);
 
-    // Disable copy semantics. Never want to copy the placement generator.
+    // Requires: this is a descendant of root, and root outlives every compact state made from it.
+    Compact_state compact(const State& root) const;
+    State(const Compact_state& compact_state, const State& root);
+
+    // Disable copy semantics. Children are made from their parent, or by make_child(), never copied.
     State& operator=(const State& other) = delete;
     State(const State& other) = delete;
 
@@ -61,20 +146,24 @@ public:
 
 private:
 
-    class Placement_generator{
+    // A child's second placement taken from the root, if placement makes the child.
+    std::optional<Placement> get_second_placement_for_child(Placement placement) const;
+
+    // The parent's fields make_child() is about to change.
+    void save_for_undo(Undo_record& undo_record) const;
 
-    public:
-        Placement_generator(const Block* _presented);
-        std::optional<Placement> operator()();
+public:
 
-    private:
-        const Block* presented;
-        int rot_x;
-        int col;
-        bool exhausted;
+    struct Undo_record {
+        Board::Undo_record board;
+        const Block* presented_block;
+        Tetris_queue_t::const_iterator next_queue_it;
+        bool is_leaf;
+        std::optional<Placement> placement_taken_from_root;
+        std::optional<Placement> second_placement_taken_from_root;
     };
 
-    std::optional<State> generate_child_from_placement(Placement placement);
+private:
 
     // Actual State Info
     Board board;
@@ -90,8 +179,11 @@ private:
     // Construction Logic
     // Empty -> This is the root.
     std::optional<Placement> placement_taken_from_root;
+    // Empty -> This is the root or its child.
+    std::optional<Placement> second_placement_taken_from_root;
 
-    Placement_generator pg;
 };
 
+static_assert(sizeof(Compact_state) == 64, "A compact state should fill exactly one cache line.");
+
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include "state_arena.h"
+
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+State_arena::Slab_t State_arena::allocate_slab(){
+
+    void* memory = std::aligned_alloc(c_slab_bytes, c_slab_bytes);
+    if(!memory){
+        throw std::bad_alloc{};
+    }
+#ifdef __linux__
+    // Only a hint. Without transparent huge pages this is a no-op.
+    madvise(memory, c_slab_bytes, MADV_HUGEPAGE);
+#endif
+    return Slab_t{static_cast<Slot*>(memory)};
+}
+
+void State_arena::Slab_deleter::operator()(Slot* slots) const {
+    std::free(slots);
+}
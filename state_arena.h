@@ -0,0 +1,96 @@
+#ifndef STATE_ARENA_H
+#define STATE_ARENA_H
+
+#include "state.h"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Hands out Compact_state slots carved from large slabs, so the search never calls malloc once warmed up.
+// Owned by one worker. Freed slots go on the freeing worker's own list, so a state stolen
+// from another worker's arena is simply adopted. That's fine because every arena is reset at once.
+class State_arena {
+
+public:
+
+    State_arena() = default;
+
+    Compact_state* create(const Compact_state& state){
+        void* slot = take_slot();
+        return new (slot) Compact_state{state};
+    }
+
+    void destroy(Compact_state* state){
+        state->~Compact_state();
+        Slot* slot = reinterpret_cast<Slot*>(state);
+        slot->next_free = free_list;
+        free_list = slot;
+    }
+
+    // Requires: No state from any arena is alive.
+    // Forgets every slot in O(1). Slabs are kept for the next search.
+    void reset(){
+        free_list = nullptr;
+        slab_x = 0;
+        slot_x = 0;
+    }
+
+    // Slots handed out since the last reset that were not reused from the free list.
+    // The most states this arena has held at once, give or take states freed into other arenas.
+    std::size_t get_num_slots_carved() const {
+        return slab_x * c_slots_per_slab + slot_x;
+    }
+
+    // Slabs allocated since this was last called.
+    long take_num_heap_allocations(){
+        return std::exchange(num_heap_allocations, 0);
+    }
+
+    State_arena(const State_arena& other) = delete;
+    State_arena& operator=(const State_arena& other) = delete;
+
+private:
+
+    union Slot {
+        Slot* next_free;
+        alignas(Compact_state) std::byte storage[sizeof(Compact_state)];
+    };
+
+    // Huge page sized, so the kernel can back a slab with a single TLB entry.
+    static constexpr std::size_t c_slab_bytes = std::size_t{1} << 21;
+    static constexpr std::size_t c_slots_per_slab = c_slab_bytes / sizeof(Slot);
+
+    struct Slab_deleter {
+        void operator()(Slot* slots) const;
+    };
+    using Slab_t = std::unique_ptr<Slot[], Slab_deleter>;
+
+    void* take_slot(){
+        if(free_list){
+            return std::exchange(free_list, free_list->next_free);
+        }
+        if(slot_x == c_slots_per_slab){
+            ++slab_x;
+            slot_x = 0;
+        }
+        if(slab_x == slabs.size()){
+            slabs.push_back(allocate_slab());
+            ++num_heap_allocations;
+        }
+        return &slabs[slab_x][slot_x++];
+    }
+
+    static Slab_t allocate_slab();
+
+    std::vector<Slab_t> slabs;
+    // Next unused slot is slabs[slab_x][slot_x].
+    std::size_t slab_x = 0;
+    std::size_t slot_x = 0;
+    Slot* free_list = nullptr;
+    long num_heap_allocations = 0;
+};
+
+#endif
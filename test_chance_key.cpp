@@ -0,0 +1,108 @@
+// Checks that Board::Utility_expectation ranks chance nodes by the expectation of each field,
+// most significant first, and not by the average of their packed keys, which lets the spread of one
+// field carry into the field above. Also checks that equal outcomes give their own key, and that
+// topping out costs a node. Usage: make test_chance_key && ./test_chance_key
+// Exits non zero iff one of the checks fails.
+
+#include "board.h"
+#include "block.h"
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::optional;
+using std::string;
+using std::vector;
+
+// Reaches into Board to pack fields into keys.
+struct Chance_key_test {
+
+    static Board::Utility make_utility(const Board::Utility_fields& fields){
+        return {{Board::pack_utility_fields(fields), 0}, fields, 0.0};
+    }
+};
+
+// A middling board out of tetris mode. Every field is clear of its limits.
+static Board::Utility_fields make_fields(bool good_trench_status, int num_holes){
+    Board::Utility_fields fields;
+    fields.good_trench_status = good_trench_status;
+    fields.num_holes = num_holes;
+    fields.in_tetris_mode = false;
+    fields.at_least_one_side_clear = true;
+    fields.num_non_tetrises = 3;
+    fields.receives_height_punishment = false;
+    fields.num_tetrises = 2;
+    fields.is_tetrisable = false;
+    fields.second_lowest_height = 7;
+    fields.sum_of_squared_heights = 600;
+    fields.num_trenches = 1;
+    fields.num_cells_filled = 70;
+    return fields;
+}
+
+static Utility_key get_expected_key(const vector<optional<Board::Utility>>& outcomes){
+    Board::Utility_expectation expectation{Board_settings{}};
+    for(const optional<Board::Utility>& outcome : outcomes){
+        expectation.add(outcome);
+    }
+    return expectation.get_key();
+}
+
+// What chance nodes used to be scored by.
+static Utility_key get_packed_average(const vector<optional<Board::Utility>>& outcomes){
+    unsigned __int128 primary_sum = 0;
+    for(const optional<Board::Utility>& outcome : outcomes){
+        primary_sum += outcome ? outcome->key.primary : 0;
+    }
+    return {static_cast<uint64_t>(primary_sum / outcomes.size()), 0};
+}
+
+static bool check(bool passed, const string& what){
+    cout << (passed ? "Passed " : "FAILED ") << what << endl;
+    return passed;
+}
+
+int main(){
+
+    bool passed = true;
+
+    // Never a good trench, but never a hole, against a good trench half the time, with many holes every time.
+    // The expected trench status decides. Averaging packed keys halves the trench bit into the holes field below it,
+    // where it is outweighed by the holes.
+    const vector<optional<Board::Utility>> clean{
+        Chance_key_test::make_utility(make_fields(false, 0)),
+        Chance_key_test::make_utility(make_fields(false, 0))
+    };
+    const vector<optional<Board::Utility>> sometimes_trench{
+        Chance_key_test::make_utility(make_fields(true, 150)),
+        Chance_key_test::make_utility(make_fields(false, 150))
+    };
+    passed &= check(get_packed_average(clean) > get_packed_average(sometimes_trench),
+        "packed averages rank the node with fewer holes first");
+    passed &= check(get_expected_key(sometimes_trench) > get_expected_key(clean),
+        "expected keys rank the node more likely to have a good trench first");
+
+    // However many equally likely outcomes there are, if they are all the same the node is worth one of them.
+    for(int num_outcomes = 1; num_outcomes <= Block::c_num_blocks; ++num_outcomes){
+        for(int num_holes : {0, 1, 17, static_cast<int>(Board::c_size)}){
+            const Board::Utility utility = Chance_key_test::make_utility(make_fields(num_holes % 2, num_holes));
+            const Utility_key key = get_expected_key(vector<optional<Board::Utility>>(num_outcomes, utility));
+            passed &= check(key.primary == utility.key.primary,
+                std::to_string(num_outcomes) + " outcomes with " + std::to_string(num_holes) + " holes are worth one");
+        }
+    }
+
+    // Topping out is the worst of every field, so it costs a node that otherwise gets the same board.
+    const Board::Utility survivor = Chance_key_test::make_utility(make_fields(false, 20));
+    const vector<optional<Board::Utility>> may_top_out{survivor, {}};
+    const vector<optional<Board::Utility>> never_tops_out{survivor, survivor};
+    passed &= check(get_expected_key(never_tops_out) > get_expected_key(may_top_out),
+        "topping out ranks below surviving");
+
+    cout << (passed ? "Passed" : "FAILED") << endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+// Checks that get_best_move() reports no move, instead of failing, when every placement tops out.
+// The board is full to the top, with one hole per row so nothing clears, and only one column a row short.
+// No block fits in one row, so every placement, and every placement after a hold, tops out.
+// Usage: make test_top_out && ./test_top_out
+// Exits non zero iff a search returns a move on that board.
+
+#include "board.h"
+#include "block.h"
+#include "state.h"
+#include "play_settings.h"
+#include "player.h"
+
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::optional;
+using std::string;
+using std::vector;
+
+static Board make_topped_out_board(){
+
+    std::stringstream ss;
+    ss << "board\n";
+    for(int row_x = static_cast<int>(Board::c_rows) - 1; row_x >= 0; --row_x){
+        for(int col_x = 0; col_x < static_cast<int>(Board::c_cols); ++col_x){
+            ss << (col_x == row_x % static_cast<int>(Board::c_cols) ? '.' : 'x') << ' ';
+        }
+        ss << '\n';
+    }
+    ss << "in_hold .\njust_swapped false\n";
+    return Board{ss};
+}
+
+// Returns true iff a search with these settings finds no move on the topped out board.
+static bool finds_no_move(const vector<string>& args){
+
+    vector<char*> argv;
+    for(const string& arg : args){
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    const Play_settings settings(static_cast<int>(argv.size()), argv.data());
+
+    Player player{settings, Board_settings{settings.policy, settings.pruning_rules, nullptr}};
+    Board board = make_topped_out_board();
+    const State::Tetris_queue_t queue(settings.queue_size, &Block::Cyan);
+    const optional<Search_result> best_move =
+        get_best_move(player, board, Block::Cyan, queue, Bag_tracker::c_full_bag, settings, {});
+    delete settings.block_generator;
+
+    cout << (best_move ? "FAILED" : "Passed");
+    for(size_t arg_x = 1; arg_x < args.size(); ++arg_x){
+        cout << ' ' << args[arg_x];
+    }
+    cout << endl;
+    return !best_move;
+}
+
+int main(){
+
+    bool passed = true;
+    passed &= finds_no_move({"main", "w", "0", "1", "1", "1", "1", "n"});
+    passed &= finds_no_move({"main", "w", "0", "3", "2", "1", "2", "n"});
+    // Iterative deepening, under limits.
+    passed &= finds_no_move({"main", "w", "0", "3", "2", "1", "2", "n", "deadline_ms=5"});
+    passed &= finds_no_move({"main", "w", "0", "3", "2", "1", "1", "n", "node_budget=1000"});
+    passed &= finds_no_move({"main", "w", "0", "3", "2", "1", "1", "n", "pruning=none"});
+    passed &= finds_no_move({"main", "w", "0", "3", "2", "1", "2", "n", "engine=beam"});
+    passed &= finds_no_move({"main", "w", "0", "3", "2", "1", "1", "n", "engine=beam", "deadline_ms=5"});
+
+    cout << (passed ? "Passed" : "FAILED") << endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+// Checks that Board::get_utility_key() orders boards the way has_greater_utility_field_by_field(),
+// the comparator it was compiled from, does. Every pair of a corpus of boards is compared, under every policy.
+// The corpus covers boards in and out of tetris mode, and the extremes each packed field must hold.
+// Lifetime counts saturate in the key, so past saturation boards are checked against copies with
+// their counts clamped. Usage: make test_utility_key && ./test_utility_key
+// Exits non zero, printing the first mismatches, iff the key disagrees with the comparator.
+
+#include "board.h"
+#include "block.h"
+#include "search_policy.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::min;
+using std::string;
+using std::vector;
+
+// Random placements, not greedy ones, so stacks grow tall and full of holes.
+static const int c_num_games = 12;
+// Greatest lifetime count the key tells apart.
+static const int c_max_count = (1 << 16) - 1;
+static const int c_max_mismatches_printed = 10;
+
+// Reaches into Board for the comparator and the fields the key is built from.
+struct Utility_key_test {
+
+    static bool in_tetris_mode(const Board& board, int max_tetris_mode_height){
+        return board.highest_height <= max_tetris_mode_height;
+    }
+
+    template <class Policy>
+    static bool key_is_greater(const Board& b1, const Board& b2){
+        return b1.get_utility_key<Policy>() > b2.get_utility_key<Policy>();
+    }
+
+    template <class Policy>
+    static bool is_greater_field_by_field(const Board& b1, const Board& b2){
+        return b1.has_greater_utility_field_by_field<Policy>(b2);
+    }
+};
+
+// Any placement that fits is made. Pruning does not change utility keys.
+static const Board_settings c_no_pruning{Policy_id::standard, Pruning_rules{false, false}, nullptr};
+
+// Every board of c_num_games games of random placements, each played until it tops out.
+static vector<Board> make_game_boards(){
+
+    std::mt19937 generator{1};
+    std::uniform_int_distribution<int> block_dist{0, Block::c_num_blocks - 1};
+
+    vector<Board> boards;
+    for(int game_x = 0; game_x < c_num_games; ++game_x){
+        Board board;
+        board.use_settings(c_no_pruning);
+        while(true){
+            board.load_ancestral_data_with_current_data();
+            const Block& block = *Block::all_blocks[block_dist(generator)];
+            const int rot_x = std::uniform_int_distribution<int>{0, block.num_rotations - 1}(generator);
+            const int max_col_x = static_cast<int>(Board::c_cols) - block.maps[rot_x].width;
+            const int col_x = std::uniform_int_distribution<int>{0, max_col_x}(generator);
+            if(!board.place_block(block, Placement{rot_x, col_x, false})){
+                break;
+            }
+            boards.push_back(board);
+        }
+    }
+    return boards;
+}
+
+// Row 0 is the bottom. '.' is empty, anything else filled. Rows above those given are empty.
+static Board make_board(const vector<string>& rows_from_bottom){
+
+    vector<string> rows(Board::c_rows, string(Board::c_cols, '.'));
+    std::copy(rows_from_bottom.begin(), rows_from_bottom.end(), rows.begin());
+
+    std::stringstream ss;
+    ss << "board\n";
+    for(auto row = rows.rbegin(); row != rows.rend(); ++row){
+        for(char cell : *row){
+            ss << (cell == '.' ? '.' : 'x') << ' ';
+        }
+        ss << '\n';
+    }
+    ss << "in_hold .\njust_swapped false\n";
+    return Board{ss};
+}
+
+// Boards at the limits of the packed fields: the tallest stacks, the greatest sum of squared heights,
+// the most holes and cells, and every column a trench.
+static vector<Board> make_limit_boards(){
+
+    const string full(Board::c_cols, 'x');
+    const string empty(Board::c_cols, '.');
+
+    vector<Board> boards;
+    // Every cell filled. Greatest height, sum of squared heights and cells.
+    boards.push_back(make_board(vector<string>(Board::c_rows, full)));
+    // All but one column, as tall as they go.
+    boards.push_back(make_board(vector<string>(Board::c_rows, "xxxxxxxxx.")));
+    boards.push_back(make_board(vector<string>(Board::c_rows, ".xxxxxxxxx")));
+    // A full top row over nothing. Most holes.
+    vector<string> roof(Board::c_rows, empty);
+    roof.back() = full;
+    boards.push_back(make_board(roof));
+    // Alternate columns. Every other column a trench, as deep as it goes.
+    boards.push_back(make_board(vector<string>(Board::c_rows, "x.x.x.x.x.")));
+    boards.push_back(make_board(vector<string>(Board::c_rows / 2, ".x.x.x.x.x")));
+    // Just in and just out of tetris mode, for every policy.
+    for(int height = 3; height <= 9; ++height){
+        boards.push_back(make_board(vector<string>(height, "xxxxxxxxx.")));
+    }
+    boards.push_back(Board{});
+    return boards;
+}
+
+// Copies of boards with lifetime counts around and past where the key saturates.
+static vector<Board> make_saturated_boards(const vector<Board>& boards){
+
+    const vector<int> counts{0, c_max_count - 1, c_max_count, c_max_count + 1, 10 * c_max_count};
+
+    vector<Board> saturated;
+    for(size_t board_x = 0; board_x < boards.size(); board_x += boards.size() / 8 + 1){
+        for(int num_tetrises : counts){
+            for(int num_non_tetrises : counts){
+                Board board = boards[board_x];
+                Board_lifetime_stats stats = board.get_lifetime_stats();
+                stats.num_tetrises = num_tetrises;
+                stats.num_non_tetrises = num_non_tetrises;
+                board.set_lifetime_stats(stats);
+                saturated.push_back(board);
+            }
+        }
+    }
+    return saturated;
+}
+
+// What the key should compare as: board with its lifetime counts clamped to what the key holds.
+static Board clamp_counts(Board board){
+    Board_lifetime_stats stats = board.get_lifetime_stats();
+    stats.num_tetrises = min(stats.num_tetrises, c_max_count);
+    stats.num_non_tetrises = min(stats.num_non_tetrises, c_max_count);
+    board.set_lifetime_stats(stats);
+    return board;
+}
+
+// Returns the number of ordered pairs of boards the key and the comparator disagree on.
+template <class Policy>
+static long check_policy(const char* policy_name, const vector<Board>& boards){
+
+    vector<Board> clamped;
+    for(const Board& board : boards){
+        clamped.push_back(clamp_counts(board));
+    }
+
+    long num_mismatches = 0;
+    long num_pairs_by_mode[2][2] = {{0, 0}, {0, 0}};
+    for(size_t b1_x = 0; b1_x < boards.size(); ++b1_x){
+        const bool b1_in_tetris_mode = Utility_key_test::in_tetris_mode(boards[b1_x], Policy::c_max_tetris_mode_height);
+        for(size_t b2_x = 0; b2_x < boards.size(); ++b2_x){
+            const bool b2_in_tetris_mode =
+                Utility_key_test::in_tetris_mode(boards[b2_x], Policy::c_max_tetris_mode_height);
+            ++num_pairs_by_mode[b1_in_tetris_mode][b2_in_tetris_mode];
+
+            const bool key_says = Utility_key_test::key_is_greater<Policy>(boards[b1_x], boards[b2_x]);
+            const bool comparator_says = Utility_key_test::is_greater_field_by_field<Policy>(clamped[b1_x], clamped[b2_x]);
+            if(key_says == comparator_says){
+                continue;
+            }
+            if(num_mismatches++ < c_max_mismatches_printed){
+                cout << policy_name << ": key says " << key_says << ", comparator says " << comparator_says
+                    << ", comparing\n" << boards[b1_x] << "\nwith\n" << boards[b2_x] << "\n";
+            }
+        }
+    }
+
+    cout << policy_name << ": " << boards.size() * boards.size() << " pairs, "
+        << num_pairs_by_mode[1][1] << " both in tetris mode, "
+        << num_pairs_by_mode[0][0] << " both out, "
+        << num_pairs_by_mode[0][1] + num_pairs_by_mode[1][0] << " mixed, "
+        << num_mismatches << " mismatches" << endl;
+
+    // A corpus missing a kind of pair checks nothing about it.
+    if(!num_pairs_by_mode[1][1] || !num_pairs_by_mode[0][0] || !num_pairs_by_mode[0][1]){
+        cout << policy_name << ": corpus is missing boards in one of the modes" << endl;
+        return num_mismatches + 1;
+    }
+    return num_mismatches;
+}
+
+int main(){
+
+    vector<Board> boards = make_game_boards();
+    const vector<Board> limit_boards = make_limit_boards();
+    boards.insert(boards.end(), limit_boards.begin(), limit_boards.end());
+    const vector<Board> saturated_boards = make_saturated_boards(boards);
+    boards.insert(boards.end(), saturated_boards.begin(), saturated_boards.end());
+
+    long num_mismatches = 0;
+    num_mismatches += check_policy<Standard_policy>("standard", boards);
+    num_mismatches += check_policy<Tall_stack_policy>("tall_stack", boards);
+    num_mismatches += check_policy<Low_stack_policy>("low_stack", boards);
+
+    if(num_mismatches){
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "Passed" << endl;
+    return 0;
+}
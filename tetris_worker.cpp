@@ -1,247 +1,542 @@
-#include "tetris_worker.h"
-
-#include <utility>
-#include <functional>
-#include <cassert>
-#include <cmath>
-#include <algorithm>
-#include <iostream>
-
-using std::vector;
-using std::unique_lock;
-using std::thread;
-using std::mutex;
-using std::move;
-using std::bind;
-using std::ceil;
-using std::max_element;
-using std::cout;
-using std::endl;
-
-static const int c_num_to_consider_with_head_down = 100;
-static const int c_offload_threshold = 2;
-
-static const std::chrono::milliseconds time_limit = std::chrono::milliseconds(10);
-
-Tetris_worker::Tetris_worker(){
-    t = thread{bind(&Tetris_worker::run, this)};
-}
-
-void Tetris_worker::restart_with_stack(vector<State>&& _state_stack){
-    assert(!_state_stack.empty());
-    best_state = {};
-    lock_set_signal_stack(move(_state_stack));
-}
-
-void Tetris_worker::lock_set_signal_stack(vector<State>&& _state_stack){
-    unique_lock<mutex> ss_ulock(ss_mutex);
-    state_stack = move(_state_stack);
-    ss_ulock.unlock();
-    ss_empty.notify_all();
-}
-
-void Tetris_worker::create_workers(int num_workers){
-    for(int i = 0; i < num_workers; ++i){
-        // Destroyed on program exit. Workers is static.
-        // Assumes we never want to destroy workers until program ends.
-        workers.push_back(new Tetris_worker);
-    }
-}
-
-void Tetris_worker::wait_until_all_free(){
-    unique_lock<mutex> fw_ulock(free_workers_mutex);
-    free_worker_added.wait(fw_ulock, [](){
-        return free_workers.size() == workers.size();
-    });
-}
-
-void Tetris_worker::assert_all_free(){
-
-    unique_lock<mutex> fw_ulock(free_workers_mutex);
-    assert(workers.size() == free_workers.size());
-}
-
-void Tetris_worker::print_workers_states(){
-
-    assert_all_free();
-
-    for(auto& free_worker : free_workers){
-        cout << "Here is a state a worker found:" << endl;
-        cout << *free_worker->best_state << endl;
-    }
-}
-
-void Tetris_worker::distribute_new_work_and_wait_till_all_free(State&& root_state){
-
-    work_start_time = std::chrono::high_resolution_clock::now();
-
-    assert_all_free();
-
-    unique_lock<mutex> fw_ulock(free_workers_mutex);
-    for(auto& fw : free_workers){
-        unique_lock<mutex> fw_ulock(fw->ss_mutex);
-        assert(fw->state_stack.empty());
-        fw->best_state = {};
-    }
-
-    // Make first generation.
-    vector<State> first_gen;
-    for(auto op_child = root_state.generate_next_child();
-            op_child; op_child = root_state.generate_next_child()){
-        first_gen.push_back(move(*op_child));
-    }
-
-    // Compute how many states each worker receives
-    // Round up as easy way to ensure don't run out of workers.
-    const size_t states_per_worker = static_cast<size_t>(
-        ceil(static_cast<double>(first_gen.size()) / workers.size())
-    );
-
-    // Hand out work.
-    vector<State> work_chunk;
-    for(auto& state : first_gen){
-        work_chunk.push_back(move(state));
-        // Give out chunk
-        if(work_chunk.size() == states_per_worker){
-            // Still holding fw lock
-            free_workers.back()->restart_with_stack(move(work_chunk));
-            free_workers.pop_back();
-            // On a moved-from object, only guaranteed safe operations are assignment and destruction.
-            work_chunk = decltype(work_chunk){};
-        }
-    }
-    if(!work_chunk.empty()){
-        free_workers.back()->restart_with_stack(move(work_chunk));
-        free_workers.pop_back();
-    }
-
-    free_worker_added.wait(fw_ulock, [](){
-        return free_workers.size() == workers.size();
-    });
-    fw_ulock.unlock();
-
-}
-
-State& Tetris_worker::get_best_reachable_state(){
-    assert_all_free();
-    Tetris_worker* best_worker = *max_element(free_workers.begin(), free_workers.end(),
-        [](const auto& fw1, const auto& fw2){
-            // Necessary because now a worker may not have any results to contribute.
-            bool fw1_empty = !fw1->best_state.has_value();
-            bool fw2_empty = !fw2->best_state.has_value();
-            if(fw1_empty != fw2_empty){
-                return fw1_empty;
-            }
-            if(fw1_empty && fw2_empty){
-                return false; // arbitrary.
-            }
-            return fw2->best_state->get_board().has_greater_utility_than(
-                fw1->best_state->get_board()
-            );
-    });
-    assert(best_worker->best_state);
-    return *best_worker->best_state;
-}
-
-void Tetris_worker::run(){
-
-    unique_lock<mutex> ss_ulock{ss_mutex};
-
-    while(true){
-
-        // We have our ss_ulock.
-        // Wait for work if necessary.
-        if(state_stack.empty()){
-            // Need if statement because threads can start with non-empty stacks.
-
-            // Mark ourselves as free.
-            unique_lock<mutex> free_workers_ulock{free_workers_mutex};
-            free_workers.push_back(this);
-            free_workers_ulock.unlock();
-            // Tell master thread to check if we're all here.
-            free_worker_added.notify_all();
-
-            // What if we're interrupted here?
-            // It is OK that the worker is marked free first, because someone should never signal us without first acquiring our ss_mutex.
-
-            // Wait until something is put in our stack.
-            // Predicate returns: Are we ready to go?
-            ss_empty.wait(ss_ulock, [this](){return !state_stack.empty();});
-        }
-        // We have ss_ulock and state_stack is not empty
-        assert(!state_stack.empty());
-
-        int num_considered_with_head_down = 0;
-
-        while(!state_stack.empty()){
-            // We have work to do.
-
-            // Do our work.
-            State considered_state = move(state_stack.back());
-            state_stack.pop_back();
-            if(considered_state.get_is_leaf()){
-                if(!best_state || considered_state.get_board().has_greater_utility_than(best_state->get_board())){
-                    best_state = move(considered_state);
-                }
-            }
-            else{
-                for(auto op_child = considered_state.generate_next_child();
-                        op_child; op_child = considered_state.generate_next_child()){
-                    state_stack.push_back(move(*op_child));
-                }
-            }
-
-            // Attempt to offload work periodically if appropriate.
-            ++num_considered_with_head_down;
-            if(num_considered_with_head_down >= c_num_to_consider_with_head_down){
-
-                num_considered_with_head_down = 0;
-
-                // auto curr_time = std::chrono::high_resolution_clock::now();
-                // if(curr_time - Tetris_worker::work_start_time > time_limit){
-                //     state_stack.clear();
-                // }
-
-                if(state_stack.size() >= c_offload_threshold){
-                    attempt_to_offload_work();
-                }
-
-            }
-        } // not empty
-
-        // Done with our work.
-
-    } // true
-} // run
-
-void Tetris_worker::attempt_to_offload_work(){
-
-    Tetris_worker* free_worker = nullptr;
-    unique_lock<mutex> free_workers_ulock(free_workers_mutex);
-    if(!free_workers.empty()){
-        free_worker = free_workers.back();
-        free_workers.pop_back();
-    }
-    free_workers_ulock.unlock();
-
-    if(!free_worker){
-        return;
-    }
-
-    // Offload
-    vector<State> my_new_state_stack;
-    vector<State> fw_new_state_stack;
-
-    bool to_me = true;
-    for(auto& state : state_stack){
-        if(to_me){
-            my_new_state_stack.push_back(move(state));
-        }
-        else{
-            fw_new_state_stack.push_back(move(state));
-        }
-        to_me = !to_me;
-    }
-    state_stack = move(my_new_state_stack);
-    free_worker->lock_set_signal_stack(move(fw_new_state_stack));
-}
\ No newline at end of file
+#include "tetris_worker.h"
+#include "engine.h"
+
+#include <utility>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+
+using std::array;
+using std::vector;
+using std::unique_lock;
+using std::thread;
+using std::mutex;
+using std::move;
+using std::min;
+using std::optional;
+using std::uint16_t;
+using std::uint64_t;
+using std::chrono::steady_clock;
+
+static const int c_num_to_consider_with_head_down = 100;
+// Idle workers yield between steal attempts, then start sleeping so as not to starve busy ones.
+static const int c_failed_steals_before_sleeping = 64;
+static const std::chrono::microseconds c_idle_sleep{20};
+
+int Tetris_worker::get_placement_index(Placement placement){
+    return placement.get_is_hold() ? State::c_max_placements - 1
+        : placement.get_rotation() * static_cast<int>(Board::c_cols) + placement.get_column();
+}
+
+Placement Tetris_worker::get_placement(int placement_index){
+    if(placement_index == State::c_max_placements - 1){
+        return Placement{0, 0, true};
+    }
+    return Placement{placement_index / static_cast<int>(Board::c_cols), placement_index % static_cast<int>(Board::c_cols), false};
+}
+
+uint16_t Tetris_worker::extend_path(Placement placement, uint16_t path_below){
+    return static_cast<uint16_t>((path_below << 8) | (1 + get_placement_index(placement)));
+}
+
+Tetris_worker::Tetris_worker(Engine& _engine, int _index)
+    : engine{_engine}, index{_index} {
+    t = thread{&Tetris_worker::run, this};
+}
+
+Tetris_worker::~Tetris_worker(){
+    unique_lock<mutex> start_ulock{start_mutex};
+    exit_requested = true;
+    start_ulock.unlock();
+    search_started.notify_one();
+    t.join();
+}
+
+void Tetris_worker::seed_best_primary_found(const vector<Placement>& expected_line){
+    dispatch_on_policy(engine.get_board_settings().policy, [this, &expected_line](auto policy){
+        seed_best_primary_found<decltype(policy)>(expected_line);
+    });
+}
+
+template <class Policy>
+void Tetris_worker::seed_best_primary_found(const vector<Placement>& expected_line){
+
+    // A copy of the root to walk down.
+    State state{engine.root->compact(*engine.root), *engine.root};
+    State::Undo_record undo_record;
+    State::Placement_list_t placements;
+
+    for(size_t ply = 0; !state.get_is_leaf(); ++ply){
+        if(ply < expected_line.size() && state.make_child<Policy>(expected_line[ply], undo_record)){
+            continue;
+        }
+        // Off the expected line. Greedily take the child with the best utility key.
+        optional<Placement> best_placement;
+        Utility_key best_child_key;
+        const int num_placements = state.generate_ordered_placements<Policy>(placements);
+        for(int placement_x = 0; placement_x < num_placements; ++placement_x){
+            if(!state.make_child<Policy>(placements[placement_x].placement, undo_record)){
+                continue;
+            }
+            const Utility_key key = state.get_board().get_utility_key<Policy>();
+            if(!best_placement || key > best_child_key){
+                best_placement = placements[placement_x].placement;
+                best_child_key = key;
+            }
+            state.unmake_child(undo_record);
+        }
+        if(!best_placement){
+            // Every line from here tops out.
+            return;
+        }
+        state.make_child<Policy>(*best_placement, undo_record);
+    }
+
+    // A real leaf, so nothing that cannot beat it needs searching.
+    const optional<Utility_key> key = get_leaf_key<Policy>(state);
+    if(key){
+        engine.publish_leaf_found(*key);
+    }
+}
+
+void Tetris_worker::run(){
+
+    long seen_search_generation = 0;
+
+    while(true){
+
+        // Wait for work.
+        unique_lock<mutex> start_ulock{start_mutex};
+        search_started.wait(start_ulock, [this, seen_search_generation](){
+            return search_generation != seen_search_generation || exit_requested;
+        });
+        if(exit_requested){
+            return;
+        }
+        seen_search_generation = search_generation;
+        start_ulock.unlock();
+
+        if(engine.task){
+            (*engine.task)(index);
+        }
+        else{
+            dispatch_on_policy(engine.get_board_settings().policy, [this](auto policy){
+                search<decltype(policy)>();
+            });
+        }
+
+        // Mark ourselves as free. Tell master thread if we're the last.
+        const auto lock_wait_start = steady_clock::now();
+        unique_lock<mutex> search_ulock{engine.search_mutex};
+        scheduling_stats.lock_wait_time += steady_clock::now() - lock_wait_start;
+        const bool last_to_finish = --engine.num_workers_searching == 0;
+        search_ulock.unlock();
+        if(last_to_finish){
+            engine.search_finished.notify_all();
+        }
+
+    } // true
+} // run
+
+template <class Policy>
+void Tetris_worker::search(){
+
+    num_considered_with_head_down = 0;
+    bool idle = false;
+    int num_failed_steals = 0;
+    steady_clock::time_point idle_start;
+
+    while(true){
+
+        optional<Compact_state*> work = deque.pop();
+
+        if(!work){
+            if(!idle){
+                idle = true;
+                idle_start = steady_clock::now();
+                engine.num_idle_workers.fetch_add(1);
+            }
+            if(engine.num_idle_workers.load() == static_cast<int>(engine.workers.size())){
+                scheduling_stats.idle_time += steady_clock::now() - idle_start;
+                break;
+            }
+            work = steal_work();
+            if(!work){
+                if(++num_failed_steals < c_failed_steals_before_sleeping){
+                    std::this_thread::yield();
+                }
+                else{
+                    std::this_thread::sleep_for(c_idle_sleep);
+                }
+                continue;
+            }
+            idle = false;
+            num_failed_steals = 0;
+            scheduling_stats.idle_time += steady_clock::now() - idle_start;
+        }
+
+        Compact_state* considered_state = *work;
+        // Once abandoned, drain without considering. Nothing half searched is kept.
+        if(!engine.search_abandoned.load(std::memory_order_relaxed)){
+            consider<Policy>(*considered_state);
+        }
+        else{
+            note_considered(1);
+        }
+        arena.destroy(considered_state);
+    }
+
+    engine.num_states_considered.fetch_add(num_considered_with_head_down, std::memory_order_relaxed);
+}
+
+optional<Compact_state*> Tetris_worker::steal_work(){
+
+    // Visit everyone else once, starting just after ourselves.
+    for(size_t offset = 1; offset < engine.workers.size(); ++offset){
+        Tetris_worker* victim = engine.workers[(index + offset) % engine.workers.size()].get();
+        if(victim->deque.looks_empty()){
+            continue;
+        }
+        // Stop being idle before taking anything, so nobody sees everyone idle while we hold work.
+        engine.num_idle_workers.fetch_sub(1);
+        optional<Compact_state*> stolen = victim->deque.steal();
+        if(stolen){
+            ++scheduling_stats.num_steals;
+            return stolen;
+        }
+        ++scheduling_stats.num_lost_steal_races;
+        engine.num_idle_workers.fetch_add(1);
+    }
+    return {};
+}
+
+template <class Policy>
+void Tetris_worker::consider(const Compact_state& compact_state){
+
+    State considered_state{compact_state, *engine.root};
+    note_considered(1);
+
+    if(considered_state.get_is_leaf()){
+        const optional<Utility_key> key = get_leaf_key<Policy>(considered_state);
+        if(key){
+            note_leaf_below_root_placement(considered_state, *key);
+        }
+        if(key && is_new_best_leaf(*key)){
+            best_state = move(considered_state);
+        }
+        return;
+    }
+    if(!can_beat_best_found<Policy>(considered_state)){
+        return;
+    }
+    if(!claim_for_expansion(considered_state)){
+        if(engine.keep_best_leaf_per_root_placement){
+            follow_transposition<Policy>(considered_state);
+        }
+        return;
+    }
+    if(considered_state.get_remaining_depth() <= c_max_in_place_depth){
+        search_in_place<Policy>(considered_state);
+        return;
+    }
+
+    const int depth = min(considered_state.get_remaining_depth(), c_max_tracked_depth - 1);
+#ifdef DEBUG
+    const Utility_key bound = get_utility_upper_bound<Policy>(considered_state);
+#endif
+
+    // Leaf children are scored as soon as they are made. The rest are pushed, best looking last,
+    // so the best looking is popped first.
+    State::Placement_list_t placements;
+    const int num_placements = considered_state.generate_ordered_placements<Policy>(placements);
+    note_placements_generated(considered_state, num_placements);
+    array<Compact_state*, State::c_max_placements> children_to_push;
+    int num_children_to_push = 0;
+
+    State::Undo_record undo_record;
+    for(int placement_x = 0; placement_x < num_placements; ++placement_x){
+        if(!make_child<Policy>(considered_state, placements[placement_x].placement, undo_record)){
+            continue;
+        }
+        ++num_children[depth];
+        if(considered_state.get_is_leaf()){
+            note_considered(1);
+            const optional<Utility_key> key = get_leaf_key<Policy>(considered_state);
+#ifdef DEBUG
+            assert(!key || !(*key > bound));
+#endif
+            if(key){
+                note_leaf_below_root_placement(considered_state, *key);
+            }
+            if(key && is_new_best_leaf(*key)){
+                best_state.emplace(considered_state.compact(*engine.root), *engine.root);
+            }
+        }
+        else{
+            // Counted when popped.
+            children_to_push[num_children_to_push++] = arena.create(considered_state.compact(*engine.root));
+        }
+        considered_state.unmake_child(undo_record);
+    }
+    scheduling_stats.num_states_shared += num_children_to_push;
+    while(num_children_to_push > 0){
+        deque.push(children_to_push[--num_children_to_push]);
+    }
+}
+
+template <class Policy>
+optional<Tetris_worker::Subtree_best> Tetris_worker::search_in_place(State& state){
+
+    const int depth = min(state.get_remaining_depth(), c_max_tracked_depth - 1);
+#ifdef DEBUG
+    const Utility_key bound = get_utility_upper_bound<Policy>(state);
+#endif
+
+    State::Placement_list_t placements;
+    const int num_placements = state.generate_ordered_placements<Policy>(placements);
+    note_placements_generated(state, num_placements);
+
+    optional<Subtree_best> best;
+    State::Undo_record undo_record;
+    for(int placement_x = 0; placement_x < num_placements; ++placement_x){
+
+        if(engine.search_abandoned.load(std::memory_order_relaxed)){
+            return {};
+        }
+        const Placement placement = placements[placement_x].placement;
+        if(!make_child<Policy>(state, placement, undo_record)){
+            continue;
+        }
+        ++num_children[depth];
+        note_considered(1);
+
+        optional<Subtree_best> below;
+        if(state.get_is_leaf()){
+            const optional<Utility_key> key = get_leaf_key<Policy>(state);
+#ifdef DEBUG
+            assert(!key || !(*key > bound));
+#endif
+            if(key){
+                note_leaf_below_root_placement(state, *key);
+                below = Subtree_best{*key, 0};
+            }
+            if(key && is_new_best_leaf(*key)){
+                // Rare, so the round trip through a compact state is cheap enough.
+                best_state.emplace(state.compact(*engine.root), *engine.root);
+            }
+        }
+        else if(can_beat_best_found<Policy>(state)){
+            if(claim_for_expansion(state)){
+                below = search_in_place<Policy>(state);
+            }
+            // Only worth a probe when leaves below root placements are read.
+            else if(engine.keep_best_leaf_per_root_placement){
+                below = follow_transposition<Policy>(state);
+            }
+        }
+        if(below && (!best || below->key > best->key)){
+            best = Subtree_best{below->key, extend_path(placement, below->path)};
+        }
+
+        state.unmake_child(undo_record);
+    }
+
+    // Half searched subtrees are not stored.
+    if(!best || engine.search_abandoned.load(std::memory_order_relaxed)){
+        return {};
+    }
+    // Results are only read to keep leaves below root placements. Otherwise the store would cost about 5% of the search.
+    if(engine.keep_best_leaf_per_root_placement){
+        engine.transposition_table.store_result(state.get_transposition_key(), {best->key, best->path});
+    }
+    return best;
+}
+
+template <class Policy>
+optional<Tetris_worker::Subtree_best> Tetris_worker::follow_transposition(State& state){
+
+    const optional<Transposition_table::Result> result =
+        engine.transposition_table.probe_result(state.get_transposition_key());
+    if(!result){
+        return {};
+    }
+    // Replaying cannot improve on a leaf already kept below this root placement.
+    const auto& best_leaf = best_leaf_by_root_placement[get_placement_index(state.get_placement_taken_from_root())];
+    if(best_leaf && !(result->best_key > best_leaf->key)){
+        return Subtree_best{result->best_key, result->path};
+    }
+
+    array<State::Undo_record, c_max_in_place_depth> undo_records;
+    int num_made = 0;
+    bool path_valid = true;
+    for(uint16_t path = result->path; path != 0 && path_valid; path >>= 8){
+        const int placement_index = (path & 0xFF) - 1;
+        const Placement placement = get_placement(placement_index);
+        const Block& block = state.get_presented_block();
+        path_valid = num_made < c_max_in_place_depth && !state.get_is_leaf() && placement_index < State::c_max_placements
+            && (placement.get_is_hold() || (placement.get_rotation() < block.num_rotations
+                && placement.get_column() <= block.get_max_valid_placement_col(placement.get_rotation())))
+            && state.make_child<Policy>(placement, undo_records[num_made]);
+        num_made += path_valid;
+    }
+    optional<Utility_key> key;
+    if(path_valid && num_made > 0 && state.get_is_leaf()){
+        key = get_leaf_key<Policy>(state);
+        if(key){
+            note_leaf_below_root_placement(state, *key);
+        }
+    }
+    while(num_made > 0){
+        state.unmake_child(undo_records[--num_made]);
+    }
+
+    if(!key){
+        return {};
+    }
+    return Subtree_best{*key, result->path};
+}
+
+void Tetris_worker::note_placements_generated(const State& state, int num_placements){
+    // Every placement but the hold is a drop. Those not generated were ruled out by scan_rotation().
+    num_rejected += state.get_presented_block().get_num_drop_placements() - (num_placements - 1);
+}
+
+template <class Policy>
+bool Tetris_worker::make_child(State& state, Placement placement, State::Undo_record& undo_record){
+    if(!state.make_child<Policy>(placement, undo_record)){
+        // A hold that cannot be made is not a placement, so is not counted.
+        num_rejected += !placement.get_is_hold();
+        return false;
+    }
+    num_hold_branches += placement.get_is_hold();
+    return true;
+}
+
+bool Tetris_worker::is_new_best_leaf(const Utility_key& key){
+    ++num_leaves_scored;
+    if(best_state && !(key > best_key)){
+        return false;
+    }
+    best_key = key;
+    num_considered_before_best = engine.num_states_considered.load(std::memory_order_relaxed)
+        + num_considered_with_head_down;
+    engine.publish_leaf_found(key);
+    return true;
+}
+
+void Tetris_worker::note_leaf_below_root_placement(const State& leaf, const Utility_key& key){
+    if(!engine.keep_best_leaf_per_root_placement){
+        return;
+    }
+    auto& best_leaf = best_leaf_by_root_placement[get_placement_index(leaf.get_placement_taken_from_root())];
+    if(!best_leaf || key > best_leaf->key){
+        best_leaf = Scored_leaf{key, leaf.compact(*engine.root)};
+    }
+}
+
+void Tetris_worker::note_considered(int num_considered){
+    num_considered_with_head_down += num_considered;
+    // Check limits periodically.
+    if(num_considered_with_head_down >= c_num_to_consider_with_head_down){
+        if(engine.limit_reached(num_considered_with_head_down)){
+            engine.search_abandoned = true;
+        }
+        num_considered_with_head_down = 0;
+    }
+}
+
+template <class Policy>
+optional<Utility_key> Tetris_worker::get_leaf_key(const State& leaf){
+    // Only a leaf the queue ran out under has placements to spare.
+    if(!engine.chance_layer || leaf.get_remaining_depth() <= 0){
+        return leaf.get_board().get_utility_key<Policy>();
+    }
+    // Scoring by expectation costs a search of its own. Bound it first.
+    if(!can_beat_best_found<Policy>(leaf)){
+        return {};
+    }
+    return get_chance_key<Policy>(leaf.get_board());
+}
+
+template <class Policy>
+Utility_key Tetris_worker::get_chance_key(const Board& leaf_board){
+
+    const uint64_t search_key = leaf_board.get_search_key();
+    Chance_cache_entry& entry = chance_cache[search_key & (chance_cache.size() - 1)];
+    if(entry.generation == engine.chance_generation && entry.search_key == search_key){
+        return entry.key;
+    }
+
+    // Scratch copy to place blocks on. Every placement is undone.
+    Board board{leaf_board};
+    long num_tried = 0;
+
+    // The held block lands the same way whichever block comes, so place it once for every branch, when first needed.
+    // A leaf that just swapped cannot swap again. Really it still has the block it swapped out to place,
+    // but the leaf does not keep it, so such leaves are scored over the possible next blocks, without the hold.
+    const Block* const held = board.get_held_block();
+    optional<Board::Utility> held_utility;
+    bool held_utility_computed = false;
+
+    // Over each possible block's best placement.
+    Board::Utility_expectation expectation{engine.get_board_settings()};
+    int num_possible = 0;
+    for(const Block* b : Block::all_blocks){
+        if(!(engine.chance_layer->possible_blocks & (1u << b->index))){
+            continue;
+        }
+        ++num_possible;
+        optional<Board::Utility> utility = board.get_best_utility_after_placing<Policy>(*b, num_tried);
+        // Swapping b for the held block is the same as placing it when they are the same block.
+        if(held && board.can_swap_block(*b)){
+            if(!held_utility_computed){
+                held_utility = board.get_best_utility_after_placing<Policy>(*held, num_tried);
+                held_utility_computed = true;
+            }
+            if(held_utility && (!utility || held_utility->key > utility->key)){
+                utility = held_utility;
+            }
+        }
+        expectation.add(utility);
+    }
+    assert(num_possible > 0);
+
+    if(engine.num_chance_placements_tried.fetch_add(num_tried, std::memory_order_relaxed) + num_tried
+            >= engine.chance_layer->budget){
+        engine.search_abandoned = true;
+    }
+
+    entry.search_key = search_key;
+    entry.generation = engine.chance_generation;
+    entry.key = expectation.get_key();
+    return entry.key;
+}
+
+template <class Policy>
+Utility_key Tetris_worker::get_utility_upper_bound(const State& state) const {
+    const std::optional<Chance_layer>& chance_layer = engine.chance_layer;
+    return state.get_utility_upper_bound<Policy>(
+        chance_layer && (chance_layer->possible_blocks & (1u << Block::Cyan.index)));
+}
+
+template <class Policy>
+bool Tetris_worker::can_beat_best_found(const State& state){
+
+    // Ties in the primary word must still be searched, to find the same leaf an exhaustive search would.
+    if(get_utility_upper_bound<Policy>(state).primary < engine.best_primary_found.load(std::memory_order_relaxed)){
+        ++num_pruned;
+        return false;
+    }
+    return true;
+}
+
+bool Tetris_worker::claim_for_expansion(const State& state){
+
+    const int depth = min(state.get_remaining_depth(), c_max_tracked_depth - 1);
+    if(engine.transposition_table.claim(state.get_transposition_key())){
+        ++num_expanded[depth];
+        return true;
+    }
+    ++num_transpositions[depth];
+    return false;
+}
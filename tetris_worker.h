@@ -1,62 +1,177 @@
-#ifndef TETRIS_WORKER_H
-#define TETRIS_WORKER_H
-
-#include <vector>
-#include <mutex>
-#include <thread>
-#include <condition_variable>
-#include <optional>
-#include <chrono>
-
-#include "state.h"
-
-// Wraps a thread object, and can find the best state given a stack of states to search through.
-class Tetris_worker {
-
-public:
-
-    Tetris_worker();
-
-    // Reset what is best, and lock and set state stack.
-    void restart_with_stack(std::vector<State>&& _state_stack);
-
-    void lock_set_signal_stack(std::vector<State>&& _state_stack);
-
-    static void create_workers(int num_workers);
-    static void wait_until_all_free();
-    static void assert_all_free();
-    static void print_workers_states();
-
-    // Gives work to all threads and marks them all as not free.
-    static void distribute_new_work_and_wait_till_all_free(State&& root_state);
-
-    // Requires: Workers are free and they just finished doing work.
-    static State& get_best_reachable_state();
-
-private:
-
-    void run();
-
-    void attempt_to_offload_work();
-
-    // Adding: free workers add themselves.
-    // Removing: busy workers remove free workers.
-    inline static std::vector<Tetris_worker*> free_workers;
-
-    inline static std::mutex free_workers_mutex;
-    inline static std::condition_variable free_worker_added;
-
-    inline static std::vector<Tetris_worker*> workers;
-
-    inline static std::chrono::time_point<std::chrono::high_resolution_clock> work_start_time;
-
-    // Construction Order matters.
-    std::optional<State> best_state;
-    std::vector<State> state_stack;
-
-    std::thread t;
-    std::mutex ss_mutex;
-    std::condition_variable ss_empty;
-};
-
-#endif
\ No newline at end of file
+#ifndef TETRIS_WORKER_H
+#define TETRIS_WORKER_H
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <optional>
+#include <array>
+#include <cstdint>
+
+#include "state.h"
+#include "work_stealing_deque.h"
+#include "state_arena.h"
+#include "engine.h"
+
+// Wraps a thread object, and searches for the best state reachable from the states in its deque.
+// Idle workers steal the oldest, and so shallowest and largest, subtrees from busy workers of the same Engine.
+// Owned by an Engine, which hands out work and gathers results.
+// Aligned so no two workers share a cache line.
+class alignas(64) Tetris_worker {
+
+public:
+
+    // Requires: This worker is free.
+    // Tells the thread to exit, and waits for it to.
+    ~Tetris_worker();
+
+    Tetris_worker(const Tetris_worker& other) = delete;
+    Tetris_worker& operator=(const Tetris_worker& other) = delete;
+
+private:
+
+    friend class Engine;
+
+    Tetris_worker(Engine& _engine, int _index);
+
+    void run();
+
+    // The search is templated on the engine's Board policy, so it is compiled once per policy.
+    // See search_policy.h. The policy is picked once per search, in run().
+
+    // Requires: Workers are free, and the engine's root is set.
+    // Dive from the root to a leaf along expected_line, then greedily, and raise best_primary_found to the leaf's.
+    // The leaf is not recorded as best. Ties in the primary word are still searched, so the search
+    // still finds the leaf it would have without the dive.
+    void seed_best_primary_found(const std::vector<Placement>& expected_line);
+    template <class Policy>
+    void seed_best_primary_found(const std::vector<Placement>& expected_line);
+
+    // Work until every worker is idle at once, which means no work is left anywhere.
+    template <class Policy>
+    void search();
+
+    // Returns empty optional if there was nothing to steal, or we lost the race for it.
+    std::optional<Compact_state*> steal_work();
+
+    // Best leaf scored below a state, and the placements from the state to it. See extend_path().
+    struct Subtree_best {
+        Utility_key key;
+        std::uint16_t path;
+    };
+
+    template <class Policy>
+    void consider(const Compact_state& compact_state);
+    // Requires: state is claimed and not a leaf.
+    // Searches everything below state depth first, by making and unmaking children on state itself,
+    // then stores the best leaf it scored in the transposition table, for whoever reaches state's position later.
+    // Empty if it scored no leaf, or the search was abandoned.
+    template <class Policy>
+    std::optional<Subtree_best> search_in_place(State& state);
+    // Requires: Someone else claimed state's position this search.
+    // Replays the path its owner stored from state, and keeps the leaf it leads to below state's root placement.
+    // The leaf is scored again, so a result stored for another position is harmless.
+    // Empty if the owner has not stored one, or the path does not lead to a leaf from state.
+    template <class Policy>
+    std::optional<Subtree_best> follow_transposition(State& state);
+    // Utility key leaves are compared by. Requires: leaf is a leaf.
+    // Empty, and counted as a prune, iff it would take scoring by expectation to find out the leaf cannot
+    // beat the best leaf found.
+    template <class Policy>
+    std::optional<Utility_key> get_leaf_key(const State& leaf);
+    // Average over the possible next blocks of the best key reachable by placing it, or the held block.
+    // Boards already scored this search are looked up instead, by search key. That covers everything
+    // else the average depends on, and the possible blocks and policy do not change during a search.
+    template <class Policy>
+    Utility_key get_chance_key(const Board& leaf_board);
+    // State's utility upper bound, allowing for the chance layer.
+    template <class Policy>
+    Utility_key get_utility_upper_bound(const State& state) const;
+    // Returns true iff a leaf with this key beats best_state, and if so records key as the best.
+    // The caller sets best_state.
+    bool is_new_best_leaf(const Utility_key& key);
+    // Count the drops generate_ordered_placements() left out of state's num_placements as rejected.
+    void note_placements_generated(const State& state, int num_placements);
+    // State's make_child(), counting the placement as a hold branch, or as rejected if it fails.
+    template <class Policy>
+    bool make_child(State& state, Placement placement, State::Undo_record& undo_record);
+    // Keep leaf if it is the best yet below its root placement, when that is asked for.
+    void note_leaf_below_root_placement(const State& leaf, const Utility_key& key);
+    // Count states considered, and check limits every so often.
+    void note_considered(int num_considered);
+
+    // Returns false, and counts a prune, iff no leaf below state can beat the best leaf any worker has found.
+    template <class Policy>
+    bool can_beat_best_found(const State& state);
+
+    // Returns true iff nobody has expanded this state's position yet this search, so we should.
+    bool claim_for_expansion(const State& state);
+
+    // Unique in [0, State::c_max_placements).
+    static int get_placement_index(Placement placement);
+    // Inverse of get_placement_index().
+    static Placement get_placement(int placement_index);
+    // Path from a state through placement, then along path_below. One byte per placement, first placement lowest:
+    // 1 + its placement index, or 0 past the end.
+    static std::uint16_t extend_path(Placement placement, std::uint16_t path_below);
+
+    static constexpr int c_log2_chance_cache_entries = 12;
+    static constexpr int c_max_tracked_depth = 16;
+    // Subtrees this many placements from the horizon are searched in place, not through the deque.
+    static constexpr int c_max_in_place_depth = 2;
+    static_assert(c_max_in_place_depth <= 2 && State::c_max_placements < 0xFF, "Paths must fit in a Subtree_best.");
+
+    Engine& engine;
+    const int index;
+
+    // This worker waits for search_generation to change, or to be told to exit.
+    std::mutex start_mutex;
+    std::condition_variable search_started;
+    long search_generation = 0;
+    bool exit_requested = false;
+
+    // Per search counters, summed by the engine once the search finishes. See Search_counters.
+    // Only touched by this worker while searching. On lines of their own, away from what thieves read.
+    // Indexed by remaining depth.
+    alignas(64) std::array<long, c_max_tracked_depth> num_expanded = {0};
+    std::array<long, c_max_tracked_depth> num_children = {0};
+    std::array<long, c_max_tracked_depth> num_transpositions = {0};
+    long num_rejected = 0;
+    long num_leaves_scored = 0;
+    long num_hold_branches = 0;
+    long num_pruned = 0;
+    Worker_scheduling_stats scheduling_stats;
+    // Considered since limits were last checked.
+    int num_considered_with_head_down = 0;
+    // Roughly how many states all workers had considered when best_state was found.
+    long num_considered_before_best = 0;
+
+    // Chance keys of boards scored by this worker, by search key. Direct mapped, so collisions just overwrite.
+    // Empty until the first search with a chance layer.
+    struct Chance_cache_entry {
+        std::uint64_t search_key = 0;
+        std::uint32_t generation = 0;
+        Utility_key key;
+    };
+    std::vector<Chance_cache_entry> chance_cache;
+
+    struct Scored_leaf {
+        Utility_key key;
+        Compact_state state;
+    };
+    // Best leaf this worker found below each root placement, by placement index. See get_placement_index().
+    std::array<std::optional<Scored_leaf>, State::c_max_placements> best_leaf_by_root_placement;
+
+    // Construction Order matters.
+    std::optional<State> best_state;
+    // Utility key of best_state, if any.
+    Utility_key best_key;
+    // States waiting to be considered. Whoever pops or steals one destroys it in their own arena.
+    Work_stealing_deque<Compact_state*> deque;
+    State_arena arena;
+
+    std::thread t;
+};
+
+#endif
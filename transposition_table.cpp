@@ -0,0 +1,111 @@
+#include "transposition_table.h"
+
+#include <cassert>
+
+using std::memory_order_acquire;
+using std::memory_order_relaxed;
+using std::memory_order_release;
+using std::optional;
+using std::size_t;
+using std::uint16_t;
+using std::uint64_t;
+
+Transposition_table::Transposition_table(int log2_num_buckets)
+    : buckets{new Bucket[size_t{1} << log2_num_buckets]},
+    bucket_mask{(size_t{1} << log2_num_buckets) - 1} {
+
+    static_assert(sizeof(Bucket) == 2 * c_cache_line_size, "A bucket should fill its two cache lines.");
+    clear();
+}
+
+void Transposition_table::new_search(){
+    ++generation;
+    if((generation & c_generation_mask) == 0){
+        // Generations wrapped around. Old entries could look current again.
+        clear();
+        generation = 1;
+    }
+}
+
+bool Transposition_table::claim(Key_t key){
+
+    assert(generation != 0 && "Call new_search() before the first claim.");
+
+    Bucket& bucket = get_bucket(key);
+
+    for(auto& slot : bucket.slots){
+        const uint64_t status = slot.status.load(memory_order_acquire);
+        Key_t seen = slot.key.load(memory_order_relaxed);
+        if((status & c_generation_mask) == generation){
+            if(seen == key){
+                return false;
+            }
+            // Someone else's claim.
+            continue;
+        }
+        // Empty or stale. Try to take it. Losing the race to a claimer of the same key makes two owners,
+        // which only costs duplicate work.
+        if(slot.key.compare_exchange_strong(seen, key, memory_order_relaxed)){
+            slot.status.store(generation, memory_order_release);
+            return true;
+        }
+    }
+
+    // Full of current claims. Evict one.
+    Slot& slot = bucket.slots[(key >> 32) % c_slots_per_bucket];
+    slot.key.store(key, memory_order_relaxed);
+    slot.status.store(generation, memory_order_release);
+    return true;
+}
+
+void Transposition_table::store_result(Key_t key, const Result& result){
+
+    Slot* slot = find(key);
+    // Only over a bare claim, so a stored result is rarely replaced by a second owner's.
+    // A race can still pair one owner's key with another's path. Readers check results, so that is left to them.
+    if(!slot || slot->status.load(memory_order_relaxed) != generation){
+        return;
+    }
+    slot->best_primary.store(result.best_key.primary, memory_order_relaxed);
+    slot->best_secondary.store(result.best_key.secondary, memory_order_relaxed);
+    slot->status.store(generation | c_has_result_bit | (uint64_t{result.path} << c_path_shift), memory_order_release);
+}
+
+optional<Transposition_table::Result> Transposition_table::probe_result(Key_t key) const {
+
+    const Slot* slot = find(key);
+    if(!slot){
+        return {};
+    }
+    const uint64_t status = slot->status.load(memory_order_acquire);
+    if((status & c_generation_mask) != generation || !(status & c_has_result_bit)){
+        return {};
+    }
+    return Result{
+        {slot->best_primary.load(memory_order_relaxed), slot->best_secondary.load(memory_order_relaxed)},
+        static_cast<uint16_t>(status >> c_path_shift)
+    };
+}
+
+Transposition_table::Bucket& Transposition_table::get_bucket(Key_t key) const {
+    return buckets[(key ^ (key >> 32)) & bucket_mask];
+}
+
+Transposition_table::Slot* Transposition_table::find(Key_t key) const {
+    for(auto& slot : get_bucket(key).slots){
+        const uint64_t status = slot.status.load(memory_order_acquire);
+        if((status & c_generation_mask) == generation && slot.key.load(memory_order_relaxed) == key){
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void Transposition_table::clear(){
+    for(size_t bucket_x = 0; bucket_x <= bucket_mask; ++bucket_x){
+        for(auto& slot : buckets[bucket_x].slots){
+            slot.key.store(0, memory_order_relaxed);
+            slot.status.store(0, memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include "board.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+// Fixed size, lock-free table of positions shared by all workers during one search.
+// The search is a pre-order DFS, so the first worker to claim a position owns its subtree:
+// the best reachable leaf of that subtree is recorded in the owner's best state.
+// Anyone reaching the same position later can drop it, since every leaf below it is already accounted for.
+// Once the owner has searched everything below a position, it stores the best leaf it found there,
+// so whoever drops the position later can still tell what was below it.
+class Transposition_table {
+
+public:
+
+    using Key_t = std::uint64_t;
+
+    // What the owner of a position found below it.
+    struct Result {
+        Utility_key best_key;
+        // How to get from the position to the leaf best_key was scored from, encoded by the owner.
+        std::uint16_t path;
+    };
+
+    // Table has 2^log2_num_buckets buckets of c_slots_per_bucket entries.
+    explicit Transposition_table(int log2_num_buckets);
+
+    // Call between searches, while nobody is probing. Forgets every claim in O(1).
+    void new_search();
+
+    // Returns true iff the caller is the first to reach key this search, and should expand it.
+    // Returns false iff key has already been claimed this search. The whole key is checked, so positions
+    // that share a bucket only cost a probe each.
+    // When a bucket is full, an old claim is evicted. That only costs duplicate work, never correctness.
+    bool claim(Key_t key);
+
+    // Requires: The caller claimed key this search, and has searched everything below it.
+    // Stores result for anyone who reaches key later. Dropped if key has been evicted since.
+    void store_result(Key_t key, const Result& result);
+
+    // The result stored for key this search, if its owner has stored one and it has not been evicted.
+    // Only a hint: racing an eviction can return another position's result, so check it before relying on it.
+    std::optional<Result> probe_result(Key_t key) const;
+
+    Transposition_table(const Transposition_table& other) = delete;
+    Transposition_table& operator=(const Transposition_table& other) = delete;
+
+private:
+
+    static constexpr std::size_t c_cache_line_size = 64;
+
+    // The whole key is kept apart from the generation, so it can be checked in full.
+    // Status holds the generation in its low 32 bits, 0 for an empty slot, then whether a result is stored,
+    // then the result's path. A claimer writes the key, then the status, so whoever reads a current status
+    // first reads the key of someone who claimed it this search.
+    struct Slot {
+        std::atomic<Key_t> key;
+        std::atomic<std::uint64_t> status;
+        std::atomic<std::uint64_t> best_primary;
+        std::atomic<std::uint64_t> best_secondary;
+    };
+
+    static constexpr int c_slots_per_bucket = 2 * c_cache_line_size / sizeof(Slot);
+    static constexpr std::uint64_t c_generation_mask = 0xFFFFFFFF;
+    static constexpr std::uint64_t c_has_result_bit = std::uint64_t{1} << 32;
+    static constexpr int c_path_shift = 40;
+
+    // Two cache lines, next to each other, so the hardware prefetcher brings in the second with the first.
+    struct alignas(2 * c_cache_line_size) Bucket {
+        Slot slots[c_slots_per_bucket];
+    };
+
+    Bucket& get_bucket(Key_t key) const;
+    // The slot holding key's claim this search, if any.
+    Slot* find(Key_t key) const;
+    void clear();
+
+    std::unique_ptr<Bucket[]> buckets;
+    std::size_t bucket_mask;
+    std::uint64_t generation = 0;
+};
+
+#endif
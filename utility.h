@@ -3,6 +3,19 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstdint>
+
+// splitmix64 finalizer. Good avalanche for sequential inputs.
+constexpr std::uint64_t mix_bits(std::uint64_t x){
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Fold value into hash.
+constexpr std::uint64_t hash_combine(std::uint64_t hash, std::uint64_t value){
+    return mix_bits(hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2)));
+}
 
 // Coordinate where commands and board info a streamed to.
 class Output_manager {
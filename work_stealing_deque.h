@@ -0,0 +1,146 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Chase-Lev deque, with the memory orderings of Le, Pop, Cohen and Zappa Nardelli,
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (2013).
+// The owner pushes and pops at the bottom like a stack. Anyone may steal the oldest item from the top.
+template <typename T>
+class Work_stealing_deque {
+
+    static_assert(std::is_trivially_copyable<T>::value, "Thieves copy items they may lose the race for.");
+
+public:
+
+    explicit Work_stealing_deque(int log2_initial_capacity = 8){
+        buffers.push_back(std::make_unique<Buffer>(std::size_t{1} << log2_initial_capacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    // Owner only.
+    void push(T item){
+        const std::int64_t b = bottom.load(std::memory_order_relaxed);
+        const std::int64_t t = top.load(std::memory_order_acquire);
+        Buffer* buf = buffer.load(std::memory_order_relaxed);
+        if(b - t > static_cast<std::int64_t>(buf->mask)){
+            buf = grow(buf, t, b);
+        }
+        buf->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only. Newest item, if any.
+    std::optional<T> pop(){
+        const std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer* buf = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t t = top.load(std::memory_order_relaxed);
+
+        std::optional<T> item;
+        if(t <= b){
+            item = buf->get(b);
+            if(t == b){
+                // Last item. Race thieves for it.
+                if(!top.compare_exchange_strong(t, t + 1,
+                        std::memory_order_seq_cst, std::memory_order_relaxed)){
+                    item.reset();
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else{
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Anyone. Oldest item, if there is one and nobody else took it first.
+    std::optional<T> steal(){
+        std::int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const std::int64_t b = bottom.load(std::memory_order_acquire);
+
+        if(t < b){
+            // Standard says consume. Every implementation promotes it to acquire anyway.
+            Buffer* buf = buffer.load(std::memory_order_acquire);
+            T item = buf->get(t);
+            if(top.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)){
+                return item;
+            }
+        }
+        return {};
+    }
+
+    // Anyone. May be stale by the time it returns.
+    bool looks_empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+    // Owner only, while nobody can be stealing. Frees buffers outgrown since the last call.
+    void release_old_buffers(){
+        if(buffers.size() > 1){
+            buffers.erase(buffers.begin(), buffers.end() - 1);
+        }
+    }
+
+    // Owner only. Buffers allocated since this was last called.
+    long take_num_heap_allocations(){
+        return std::exchange(num_heap_allocations, 0);
+    }
+
+private:
+
+    struct Buffer {
+
+        explicit Buffer(std::size_t capacity)
+            : mask{capacity - 1}, items{new std::atomic<T>[capacity]} {
+        }
+
+        T get(std::int64_t x) const {
+            return items[x & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t x, T item){
+            items[x & mask].store(item, std::memory_order_relaxed);
+        }
+
+        std::size_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    // Thieves may still be reading the old buffer, so it is kept until release_old_buffers().
+    Buffer* grow(Buffer* old_buf, std::int64_t t, std::int64_t b){
+        buffers.push_back(std::make_unique<Buffer>(2 * (old_buf->mask + 1)));
+        ++num_heap_allocations;
+        Buffer* new_buf = buffers.back().get();
+        for(std::int64_t x = t; x < b; ++x){
+            new_buf->put(x, old_buf->get(x));
+        }
+        buffer.store(new_buf, std::memory_order_release);
+        return new_buf;
+    }
+
+    static constexpr std::size_t c_cache_line_size = 64;
+
+    // Thieves hammer top. The owner hammers bottom.
+    alignas(c_cache_line_size) std::atomic<std::int64_t> top{0};
+    alignas(c_cache_line_size) std::atomic<std::int64_t> bottom{0};
+    alignas(c_cache_line_size) std::atomic<Buffer*> buffer{nullptr};
+
+    // Owner only. The current buffer is last.
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    long num_heap_allocations = 0;
+};
+
+#endif